@@ -21,6 +21,7 @@
 #if HAVE_LIBARCHIVE
 #  include <archive.h>
 #  include <archive_entry.h>
+#  include <sys/stat.h>
 #endif
 // C++
 #if HAVE_LIBXML
@@ -28,6 +29,8 @@
 #endif
 #include <string>
 #include <map>
+#include <set>
+#include <future>
 
 using std::string;
 using std::map;
@@ -46,8 +49,12 @@ using std::map;
 namespace hfst_ospell
   {
 
+//! whether the last suggestion search of this thread was cut short
+static thread_local bool last_suggestions_truncated = false;
+
 #if HAVE_LIBARCHIVE
 inline std::string extract_to_mem(archive* ar, archive_entry* entry) {
+    LoadPhaseTimer timer("zip decoding");
     size_t full_length = 0;
     const struct stat* st = archive_entry_stat(entry);
     size_t buffsize = st->st_size;
@@ -57,6 +64,7 @@ inline std::string extract_to_mem(archive* ar, archive_entry* entry) {
     }
 
     std::string buff(buffsize, 0);
+    timer.add_bytes(buffsize);
     for (;;) {
         auto curr = archive_read_data(ar, &buff[0] + full_length, buffsize - full_length);
         if (0 == curr) {
@@ -91,6 +99,7 @@ inline Transducer* transducer_to_mem(archive* ar, archive_entry* entry) {
 }
 
 inline char* extract_to_tmp_dir(archive* ar) {
+    LoadPhaseTimer timer("tmp extraction");
 #ifdef WIN32
     char rv[MAX_PATH+1];
     if (!GetTempPathA(MAX_PATH, rv)) {
@@ -121,8 +130,127 @@ inline Transducer* transducer_to_tmp_dir(archive* ar) {
     return new Transducer(f);
 }
 
+inline Transducer* transducer_from_archive(archive* ar, archive_entry* entry) {
+    Transducer* trans = nullptr;
+#if ZHFST_EXTRACT_TO_MEM == 1
+    // Try to memory first...
+    try {
+        trans = transducer_to_mem(ar, entry);
+    }
+    catch (...) {
+        // If that failed, try to /tmp
+        //std::cerr << "Failed to memory - falling back to /tmp" << std::endl;
+        trans = transducer_to_tmp_dir(ar);
+    }
+#else
+    // Try to /tmp first...
+    try {
+        trans = transducer_to_tmp_dir(ar);
+    }
+    catch (...) {
+        // If that failed, try to memory
+        //std::cerr << "Failed to /tmp - falling back to memory" << std::endl;
+        trans = transducer_to_mem(ar, entry);
+    }
+#endif
+    return trans;
+}
+
+inline archive* open_zhfst(const std::string& filename) {
+    LoadPhaseTimer timer("archive opening");
+    struct archive* ar = archive_read_new();
+
+#if USE_LIBARCHIVE_2
+    archive_read_support_compression_all(ar);
+#else
+    archive_read_support_filter_all(ar);
+#endif // USE_LIBARCHIVE_2
+
+    archive_read_support_format_all(ar);
+    int rr = archive_read_open_filename(ar, filename.c_str(), 10240);
+    if (rr != ARCHIVE_OK)
+      {
+        throw ZHfstZipReadingError("Archive not OK");
+      }
+    return ar;
+}
+
+inline void close_zhfst(archive* ar) {
+    archive_read_close(ar);
+
+#if USE_LIBARCHIVE_2
+    archive_read_finish(ar);
+#else
+    archive_read_free(ar);
+#endif // USE_LIBARCHIVE_2
+}
+
+//! @brief what tells the file @a filename apart from one put in its place:
+//!        its device, inode, size and modification time.
+inline std::string archive_identity(const std::string& filename) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+      {
+        throw ZHfstZipReadingError("Cannot stat " + filename);
+      }
+    return std::to_string(st.st_dev) + ":" + std::to_string(st.st_ino) +
+        ":" + std::to_string(st.st_size) + ":" +
+        std::to_string(st.st_mtime);
+}
+
+//! @brief open @a filename and seek to the archive entry @a pathname.
+//!
+//! Throws if the file is no longer the one whose archive_identity() was
+//! @a identity, and returns null if there is no such entry.
+inline archive* open_zhfst_entry(const std::string& filename,
+                                 const std::string& identity,
+                                 const std::string& pathname,
+                                 archive_entry** entry) {
+    if (archive_identity(filename) != identity)
+      {
+        throw ZHfstZipReadingError(filename + " has changed since its "
+                                   "metadata was read");
+      }
+    struct archive* ar = open_zhfst(filename);
+    for (int rr = archive_read_next_header(ar, entry);
+         rr != ARCHIVE_EOF;
+         rr = archive_read_next_header(ar, entry))
+      {
+        if (rr != ARCHIVE_OK)
+          {
+            close_zhfst(ar);
+            throw ZHfstZipReadingError("Archive not OK");
+          }
+        if (pathname == archive_entry_pathname(*entry))
+          {
+            return ar;
+          }
+        archive_read_data_skip(ar);
+      }
+    close_zhfst(ar);
+    return nullptr;
+}
+
 #endif // HAVE_LIBARCHIVE
 
+//! @brief get the description part of "acceptor.default.hfst" style names.
+inline std::string entry_description(const char* filename, const char* prefix) {
+    const char* p = filename + strlen(prefix);
+    size_t descr_len = 0;
+    for (const char* q = p; *q != '\0'; q++)
+      {
+        if (*q == '.')
+          {
+            break;
+          }
+        else
+          {
+            descr_len++;
+          }
+      }
+    return std::string(p, descr_len);
+}
+
 ZHfstOspeller::ZHfstOspeller() :
     suggestions_maximum_(0),
     maximum_weight_(-1.0),
@@ -131,8 +259,17 @@ ZHfstOspeller::ZHfstOspeller() :
     can_spell_(false),
     can_correct_(false),
     can_analyse_(true),
+    parallel_loading_(false),
+    cache_budget_(0),
+    suffix_memo_budget_(0),
+    suffix_memo_length_(4),
+    node_budget_(0),
+    completion_count_(0),
+    case_folding_(false),
     current_speller_(0),
-    current_sugger_(0)
+    current_sugger_(0),
+    memory_growth_(0),
+    speller_ready_(false)
     {
     }
 
@@ -152,6 +289,10 @@ ZHfstOspeller::~ZHfstOspeller()
         current_sugger_ = 0;
         current_speller_ = 0;
       }
+    for (auto* copy : speller_copies_)
+      {
+        delete copy;
+      }
     for (auto& acceptor : acceptors_)
       {
         delete acceptor.second;
@@ -167,10 +308,13 @@ ZHfstOspeller::~ZHfstOspeller()
 void
 ZHfstOspeller::inject_speller(Speller * s)
   {
+      std::lock_guard<std::mutex> loading(load_mutex_);
       current_speller_ = s;
       current_sugger_ = s;
+      idle_spellers_.assign(1, s);
       can_spell_ = true;
       can_correct_ = true;
+      speller_ready_ = true;
   }
 
 void
@@ -197,69 +341,319 @@ ZHfstOspeller::set_time_cutoff(float time_cutoff)
       time_cutoff_ = time_cutoff;
   }
 
+void
+ZHfstOspeller::set_parallel_loading(bool parallel)
+  {
+      parallel_loading_ = parallel;
+  }
+
+void
+ZHfstOspeller::set_cache_budget(size_t bytes)
+  {
+      cache_budget_ = bytes;
+      for_each_speller([bytes](Speller* s) { s->set_cache_budget(bytes); });
+  }
+
+void
+ZHfstOspeller::set_suffix_memo(size_t bytes, unsigned int length)
+  {
+      suffix_memo_budget_ = bytes;
+      suffix_memo_length_ = length;
+      for_each_speller([bytes, length](Speller* s)
+                       { s->set_suffix_memo(bytes, length); });
+  }
+
+void
+ZHfstOspeller::set_node_budget(unsigned long nodes)
+  {
+      node_budget_ = nodes;
+      for_each_speller([nodes](Speller* s) { s->set_node_budget(nodes); });
+  }
+
+void
+ZHfstOspeller::set_completion_count(unsigned int count)
+  {
+      completion_count_ = count;
+      for_each_speller([count](Speller* s) { s->set_completion_count(count); });
+  }
+
+void
+ZHfstOspeller::set_case_folding(bool on)
+  {
+      case_folding_ = on;
+      for_each_speller([on](Speller* s) { s->set_case_folding(on); });
+  }
+
+void
+ZHfstOspeller::set_concurrency(unsigned int searches)
+  {
+    ensure_speller();
+    if (current_sugger_ == 0)
+      {
+        return;
+      }
+    // the copies may be in use until then
+    std::unique_lock<std::mutex> idle = wait_until_idle();
+    for (auto* copy : speller_copies_)
+      {
+        current_sugger_->statistics.merge(copy->statistics);
+        delete copy;
+      }
+    speller_copies_.clear();
+    idle_spellers_.assign(1, current_sugger_);
+    for (unsigned int i = 1; i < searches; ++i)
+      {
+        Speller* copy = new Speller(*current_sugger_);
+        // only the searches of the copy itself are counted in it
+        copy->statistics = SearchStatistics();
+        speller_copies_.push_back(copy);
+        idle_spellers_.push_back(copy);
+      }
+  }
+
+void
+ZHfstOspeller::for_each_speller(std::function<void(Speller*)> change)
+  {
+    if (current_sugger_ == 0)
+      {
+        return;
+      }
+    std::unique_lock<std::mutex> idle = wait_until_idle();
+    change(current_sugger_);
+    for (auto* copy : speller_copies_)
+      {
+        change(copy);
+      }
+  }
+
+std::unique_lock<std::mutex>
+ZHfstOspeller::wait_until_idle() const
+  {
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    speller_idle_.wait(lock, [this]()
+                       {
+                         return idle_spellers_.size() ==
+                             speller_copies_.size() + 1;
+                       });
+    return lock;
+  }
+
+void
+ZHfstOspeller::refresh_speller_copies()
+  {
+    for (auto* copy : speller_copies_)
+      {
+        SearchStatistics statistics = copy->statistics;
+        *copy = *current_sugger_;
+        copy->statistics = statistics;
+      }
+  }
+
+template <typename Result>
+Result
+ZHfstOspeller::with_speller(const string* wordforms, size_t count,
+                            Result none,
+                            std::function<Result(Speller*, char**)> search)
+  {
+    ensure_speller();
+    if (current_sugger_ == 0)
+      {
+        return none;
+      }
+    Speller* speller;
+    {
+      std::unique_lock<std::mutex> lock(idle_mutex_);
+      speller_idle_.wait(lock, [this]() { return !idle_spellers_.empty(); });
+      speller = idle_spellers_.back();
+      idle_spellers_.pop_back();
+    }
+    // give the speller back however the search ends
+    struct IdleReturn
+      {
+        ZHfstOspeller* owner;
+        Speller* speller;
+        size_t memory_before;
+        std::vector<char*> wfs;
+        ~IdleReturn()
+          {
+            for (char* wf : wfs)
+              {
+                free(wf);
+              }
+            // wraps around when the search dropped more than it added
+            owner->memory_growth_ += speller->search_memory_size() -
+                memory_before;
+            {
+              std::lock_guard<std::mutex> lock(owner->idle_mutex_);
+              owner->idle_spellers_.push_back(speller);
+            }
+            // both searches and wait_until_idle() may be waiting
+            owner->speller_idle_.notify_all();
+          }
+      } idle_return = {this, speller, speller->search_memory_size(),
+                       std::vector<char*>()};
+    bool new_symbols = false;
+    for (size_t i = 0; i < count; ++i)
+      {
+        idle_return.wfs.push_back(strdup(wordforms[i].c_str()));
+      }
+    {
+      // Searches only read the automata unless the input has symbols
+      // they lack, which are then added while no one else searches
+      std::shared_lock<std::shared_mutex> shared(symbols_mutex_);
+      for (char* wf : idle_return.wfs)
+        {
+          new_symbols = new_symbols || speller->has_new_symbols(wf);
+        }
+      if (!new_symbols)
+        {
+          speller->sync_symbols();
+          return search(speller, idle_return.wfs.data());
+        }
+    }
+    std::unique_lock<std::shared_mutex> exclusive(symbols_mutex_);
+    speller->sync_symbols();
+    return search(speller, idle_return.wfs.data());
+  }
+
+template <typename Result>
+Result
+ZHfstOspeller::with_speller(const string& wordform, Result none,
+                            std::function<Result(Speller*, char*)> search)
+  {
+    return with_speller<Result>(&wordform, 1, none,
+                                [&search](Speller* speller, char** wfs)
+                                { return search(speller, wfs[0]); });
+  }
+
 bool
 ZHfstOspeller::spell(const string& wordform)
   {
-    if (can_spell_ && (current_speller_ != 0))
+    ensure_speller();
+    if (!can_spell_)
       {
-        char* wf = strdup(wordform.c_str());
-        bool rv = current_speller_->check(wf);
-        free(wf);
-        return rv;
+        return false;
       }
-    return false;
+    // the speller is always the same as the sugger
+    return with_speller<bool>(wordform, false,
+                              [](Speller* speller, char* wf)
+                              { return speller->check(wf); });
   }
 
 CorrectionQueue
 ZHfstOspeller::suggest(const string& wordform)
   {
-    CorrectionQueue rv;
-    if ((can_correct_) && (current_sugger_ != 0))
+    ensure_speller();
+    if (!can_correct_)
       {
-        char* wf = strdup(wordform.c_str());
-        rv = current_sugger_->correct(wf,
-                                      suggestions_maximum_,
-                                      maximum_weight_,
-                                      beam_,
-                                      time_cutoff_);
-        free(wf);
-        return rv;
+        return CorrectionQueue();
       }
-    return rv;
+    return with_speller<CorrectionQueue>(
+        wordform, CorrectionQueue(),
+        [this](Speller* sugger, char* wf)
+        {
+          CorrectionQueue rv = sugger->correct(wf,
+                                               suggestions_maximum_,
+                                               maximum_weight_,
+                                               beam_,
+                                               time_cutoff_);
+          last_suggestions_truncated = sugger->truncated;
+          return rv;
+        });
   }
 
-AnalysisQueue
-ZHfstOspeller::analyse(const string& wordform, bool ask_sugger)
+std::vector<CorrectionQueue>
+ZHfstOspeller::suggest(const std::vector<string>& wordforms,
+                       const std::vector<Weight>& offsets)
   {
-    AnalysisQueue rv;
-    char* wf = strdup(wordform.c_str());
-    if ((can_analyse_) && (!ask_sugger) && (current_speller_ != 0))
+    ensure_speller();
+    std::vector<CorrectionQueue> none(wordforms.size());
+    if (!can_correct_ || wordforms.empty())
       {
-          rv = current_speller_->analyse(wf);
+        return none;
       }
-    else if ((can_analyse_) && (ask_sugger) && (current_sugger_ != 0))
+    return with_speller<std::vector<CorrectionQueue> >(
+        wordforms.data(), wordforms.size(), none,
+        [this, &wordforms, &offsets](Speller* sugger, char** wfs)
+        {
+          std::vector<char*> lines(wfs, wfs + wordforms.size());
+          // word forms without an offset have none
+          std::vector<Weight> weights(offsets);
+          weights.resize(wordforms.size(), 0.0);
+          std::vector<CorrectionQueue> rv = sugger->correct(
+              lines, weights, suggestions_maximum_, maximum_weight_, beam_,
+              time_cutoff_);
+          last_suggestions_truncated = sugger->truncated;
+          return rv;
+        });
+  }
+
+CorrectionQueue
+ZHfstOspeller::suggest(CorrectionSession& session, const string& wordform)
+  {
+    ensure_speller();
+    if (!can_correct_)
       {
-          rv = current_sugger_->analyse(wf);
+        return CorrectionQueue();
       }
-    free(wf);
-    return rv;
+    return with_speller<CorrectionQueue>(
+        wordform, CorrectionQueue(),
+        [this, &session](Speller* sugger, char* wf)
+        {
+          CorrectionQueue rv = sugger->correct(session, wf,
+                                               suggestions_maximum_,
+                                               maximum_weight_,
+                                               beam_);
+          last_suggestions_truncated = sugger->truncated;
+          return rv;
+        });
   }
 
-AnalysisSymbolsQueue
-ZHfstOspeller::analyseSymbols(const string& wordform, bool ask_sugger)
+bool
+ZHfstOspeller::suggestions_truncated() const
+  {
+    return last_suggestions_truncated;
+  }
+
+CorrectionQueue
+ZHfstOspeller::complete(const string& prefix)
+  {
+    return with_speller<CorrectionQueue>(
+        prefix, CorrectionQueue(),
+        [this](Speller* speller, char* wf)
+        {
+          return speller->complete(wf, suggestions_maximum_,
+                                   maximum_weight_);
+        });
+  }
+
+AnalysisQueue
+ZHfstOspeller::analyse(const string& wordform, bool ask_sugger)
   {
-    AnalysisSymbolsQueue rv;
-    char* wf = strdup(wordform.c_str());
-    if ((can_analyse_) && (!ask_sugger) && (current_speller_ != 0))
+    (void)ask_sugger; // the speller is always the same as the sugger
+    ensure_speller();
+    if (!can_analyse_)
       {
-          rv = current_speller_->analyseSymbols(wf);
+        return AnalysisQueue();
       }
-    else if ((can_analyse_) && (ask_sugger) && (current_sugger_ != 0))
+    return with_speller<AnalysisQueue>(wordform, AnalysisQueue(),
+                                       [](Speller* speller, char* wf)
+                                       { return speller->analyse(wf); });
+  }
+
+AnalysisSymbolsQueue
+ZHfstOspeller::analyseSymbols(const string& wordform, bool ask_sugger)
+  {
+    (void)ask_sugger;
+    ensure_speller();
+    if (!can_analyse_)
       {
-          rv = current_sugger_->analyseSymbols(wf);
+        return AnalysisSymbolsQueue();
       }
-    free(wf);
-    return rv;
+    return with_speller<AnalysisSymbolsQueue>(
+        wordform, AnalysisSymbolsQueue(),
+        [](Speller* speller, char* wf)
+        { return speller->analyseSymbols(wf); });
   }
 
 AnalysisCorrectionQueue
@@ -287,186 +681,106 @@ void
 ZHfstOspeller::read_zhfst(const string& filename)
   {
 #if HAVE_LIBARCHIVE
-    struct archive* ar = archive_read_new();
+    LoadProfiler profiler(&load_profile_);
+    // the automata are read later from the same file, so a file put in its
+    // place meanwhile must not be mixed with this metadata
+    archive_identity_ = archive_identity(filename);
+    struct archive* ar = open_zhfst(filename);
     struct archive_entry* entry = 0;
-
-#if USE_LIBARCHIVE_2
-    archive_read_support_compression_all(ar);
-#else
-    archive_read_support_filter_all(ar);
-#endif // USE_LIBARCHIVE_2
-
-    archive_read_support_format_all(ar);
-    int rr = archive_read_open_filename(ar, filename.c_str(), 10240);
-    if (rr != ARCHIVE_OK)
-      {
-        throw ZHfstZipReadingError("Archive not OK");
-      }
+    filename_ = filename;
     for (int rr = archive_read_next_header(ar, &entry);
          rr != ARCHIVE_EOF;
          rr = archive_read_next_header(ar, &entry))
       {
         if (rr != ARCHIVE_OK)
           {
+            close_zhfst(ar);
             throw ZHfstZipReadingError("Archive not OK");
           }
-        char* filename = strdup(archive_entry_pathname(entry));
-        if (strncmp(filename, "acceptor.", strlen("acceptor.")) == 0) {
-            Transducer* trans = nullptr;
-
-#if ZHFST_EXTRACT_TO_MEM == 1
-            // Try to memory first...
-            try {
-                trans = transducer_to_mem(ar, entry);
-            }
-            catch (...) {
-                // If that failed, try to /tmp
-                //std::cerr << "Failed to memory - falling back to /tmp" << std::endl;
-                trans = transducer_to_tmp_dir(ar);
-            }
-#else
-            // Try to /tmp first...
-            try {
-                trans = transducer_to_tmp_dir(ar);
-            }
-            catch (...) {
-                // If that failed, try to memory
-                //std::cerr << "Failed to /tmp - falling back to memory" << std::endl;
-                trans = transducer_to_mem(ar, entry);
-            }
-#endif
-            if (trans == nullptr) {
-                throw ZHfstZipReadingError("Failed to extract acceptor");
-            }
-
-            char* p = filename;
-            p += strlen("acceptor.");
-            size_t descr_len = 0;
-            for (const char* q = p; *q != '\0'; q++)
-              {
-                if (*q == '.')
-                  {
-                    break;
-                  }
-                else
-                    {
-                      descr_len++;
-                    }
-              }
-
-            char* descr = hfst_strndup(p, descr_len);
-            acceptors_[descr] = trans;
-            free(descr);
+        const char* pathname = archive_entry_pathname(entry);
+        // Automata are only recorded here, they get extracted and parsed
+        // when a speller first needs them
+        if (strncmp(pathname, "acceptor.", strlen("acceptor.")) == 0)
+          {
+            acceptor_entries_[entry_description(pathname, "acceptor.")] =
+                pathname;
+            archive_read_data_skip(ar);
           }
-        else if (strncmp(filename, "errmodel.", strlen("errmodel.")) == 0) {
-            Transducer* trans = nullptr;
-
-#if ZHFST_EXTRACT_TO_MEM == 1
-            // Try to memory first...
-            try {
-                trans = transducer_to_mem(ar, entry);
-            }
-            catch (...) {
-                // If that failed, try to /tmp
-                //std::cerr << "Failed to memory - falling back to /tmp" << std::endl;
-                trans = transducer_to_tmp_dir(ar);
-            }
-#else
-            // Try to /tmp first...
-            try {
-                trans = transducer_to_tmp_dir(ar);
-            }
-            catch (...) {
-                // If that failed, try to memory
-                //std::cerr << "Failed to /tmp - falling back to memory" << std::endl;
-                trans = transducer_to_mem(ar, entry);
-            }
-#endif
-            if (trans == nullptr) {
-                throw ZHfstZipReadingError("Failed to extract error model");
-            }
-
-            const char* p = filename;
-            p += strlen("errmodel.");
-            size_t descr_len = 0;
-            for (const char* q = p; *q != '\0'; q++)
-              {
-                if (*q == '.')
-                  {
-                    break;
-                  }
-                else
-                  {
-                    descr_len++;
-                  }
-              }
-
-            char* descr = hfst_strndup(p, descr_len);
-            errmodels_[descr] = trans;
-            free(descr);
-          } // if acceptor or errmodel
-        else if (strcmp(filename, "index.xml") == 0) {
-            // Always try to memory first, as index.xml is tiny
+        else if (strncmp(pathname, "errmodel.", strlen("errmodel.")) == 0)
+          {
+            errmodel_entries_[entry_description(pathname, "errmodel.")] =
+                pathname;
+            archive_read_data_skip(ar);
+          }
+        else if (strncmp(pathname, "cache.", strlen("cache.")) == 0)
+          {
+            cache_entries_[entry_description(pathname, "cache.")] = pathname;
+            archive_read_data_skip(ar);
+          }
+        else if (strncmp(pathname, "completions.",
+                         strlen("completions.")) == 0)
+          {
+            completion_entries_[entry_description(pathname,
+                                                  "completions.")] = pathname;
+            archive_read_data_skip(ar);
+          } // if acceptor or errmodel or cache or completions
+        else if (strcmp(pathname, "index.xml") == 0)
+          {
             try {
-                std::string full_data = extract_to_mem(ar, entry);
-                metadata_.read_xml(&full_data[0], full_data.size());
+                // Always try to memory first, as index.xml is tiny
+                try {
+                    std::string full_data = extract_to_mem(ar, entry);
+                    LoadPhaseTimer timer("xml metadata parsing");
+                    metadata_.read_xml(&full_data[0], full_data.size());
+                }
+                catch (...) {
+                    char* temporary = extract_to_tmp_dir(ar);
+                    LoadPhaseTimer timer("xml metadata parsing");
+                    metadata_.read_xml(temporary);
+                    free(temporary);
+                }
             }
             catch (...) {
-                char* temporary = extract_to_tmp_dir(ar);
-                metadata_.read_xml(temporary);
-                free(temporary);
+                close_zhfst(ar);
+                throw;
             }
           }
         else
           {
-            fprintf(stderr, "Unknown file in archive %s\n", filename);
+            fprintf(stderr, "Unknown file in archive %s\n", pathname);
+            archive_read_data_skip(ar);
           }
-        free(filename);
       } // while r != ARCHIVE_EOF
-    archive_read_close(ar);
+    close_zhfst(ar);
 
-#if USE_LIBARCHIVE_2
-    archive_read_finish(ar);
-#else
-    archive_read_free(ar);
-#endif // USE_LIBARCHIVE_2
-
-    if ((errmodels_.find("default") != errmodels_.end()) &&
-        (acceptors_.find("default") != acceptors_.end()))
+    if ((errmodel_entries_.find("default") != errmodel_entries_.end()) &&
+        (acceptor_entries_.find("default") != acceptor_entries_.end()))
       {
-        current_speller_ = new Speller(
-                                       errmodels_["default"],
-                                       acceptors_["default"]
-                                       );
-        current_sugger_ = current_speller_;
+        speller_acceptor_ = "default";
+        speller_errmodel_ = "default";
         can_spell_ = true;
         can_correct_ = true;
       }
-    else if ((acceptors_.size() > 0) && (errmodels_.size() > 0))
+    else if ((acceptor_entries_.size() > 0) && (errmodel_entries_.size() > 0))
       {
         fprintf(stderr, "Could not find default speller, using %s %s\n",
-                acceptors_.begin()->first.c_str(),
-                errmodels_.begin()->first.c_str());
-        current_speller_ = new Speller(
-                                       errmodels_.begin()->second,
-                                       acceptors_.begin()->second
-                                       );
-        current_sugger_ = current_speller_;
+                acceptor_entries_.begin()->first.c_str(),
+                errmodel_entries_.begin()->first.c_str());
+        speller_acceptor_ = acceptor_entries_.begin()->first;
+        speller_errmodel_ = errmodel_entries_.begin()->first;
         can_spell_ = true;
         can_correct_ = true;
       }
-    else if ((acceptors_.size() > 0) &&
-             (acceptors_.find("default") != acceptors_.end()))
+    else if ((acceptor_entries_.size() > 0) &&
+             (acceptor_entries_.find("default") != acceptor_entries_.end()))
       {
-        current_speller_ = new Speller(0, acceptors_["default"]);
-        current_sugger_ = current_speller_;
+        speller_acceptor_ = "default";
         can_spell_ = true;
         can_correct_ = false;
       }
-    else if (acceptors_.size() > 0)
+    else if (acceptor_entries_.size() > 0)
       {
-        current_speller_ = new Speller(0, acceptors_.begin()->second);
-        current_sugger_ = current_speller_;
+        speller_acceptor_ = acceptor_entries_.begin()->first;
         can_spell_ = true;
         can_correct_ = false;
       }
@@ -480,6 +794,431 @@ ZHfstOspeller::read_zhfst(const string& filename)
 #endif // HAVE_LIBARCHIVE
   }
 
+Transducer*
+ZHfstOspeller::load_transducer(const string& pathname)
+  {
+#if HAVE_LIBARCHIVE
+    struct archive_entry* entry = 0;
+    struct archive* ar = open_zhfst_entry(filename_, archive_identity_,
+                                           pathname, &entry);
+    Transducer* trans = nullptr;
+    if (ar != nullptr)
+      {
+        try
+          {
+            trans = transducer_from_archive(ar, entry);
+          }
+        catch (...)
+          {
+            close_zhfst(ar);
+            throw;
+          }
+        close_zhfst(ar);
+      }
+    if (trans == nullptr)
+      {
+        throw ZHfstZipReadingError("Failed to extract " + pathname);
+      }
+    return trans;
+#else
+    (void)pathname;
+    throw ZHfstZipReadingError("Zip support was disabled");
+#endif // HAVE_LIBARCHIVE
+  }
+
+std::string
+ZHfstOspeller::load_entry(const string& pathname)
+  {
+#if HAVE_LIBARCHIVE
+    struct archive_entry* entry = 0;
+    struct archive* ar = open_zhfst_entry(filename_, archive_identity_,
+                                           pathname, &entry);
+    if (ar == nullptr)
+      {
+        throw ZHfstZipReadingError("Failed to extract " + pathname);
+      }
+    std::string data;
+    try
+      {
+        data = extract_to_mem(ar, entry);
+      }
+    catch (...)
+      {
+        close_zhfst(ar);
+        throw;
+      }
+    close_zhfst(ar);
+    return data;
+#else
+    (void)pathname;
+    throw ZHfstZipReadingError("Zip support was disabled");
+#endif // HAVE_LIBARCHIVE
+  }
+
+Transducer*
+ZHfstOspeller::get_transducer(std::map<std::string, Transducer*>& loaded,
+                              const std::map<std::string, std::string>& entries,
+                              const string& descr)
+  {
+    auto it = loaded.find(descr);
+    if (it != loaded.end())
+      {
+        return it->second;
+      }
+    auto entry = entries.find(descr);
+    if (entry == entries.end())
+      {
+        throw ZHfstZipReadingError("No automaton " + descr + " in zip");
+      }
+    Transducer* trans = load_transducer(entry->second);
+    loaded[descr] = trans;
+    return trans;
+  }
+
+void
+ZHfstOspeller::ensure_speller()
+  {
+    if (speller_ready_)
+      {
+        return;
+      }
+    // the first searches of several threads wait for one of them to load
+    std::lock_guard<std::mutex> loading(load_mutex_);
+    if ((current_speller_ != 0) || speller_acceptor_.empty())
+      {
+        return;
+      }
+    LoadProfiler profiler(&load_profile_);
+    if (parallel_loading_ && !speller_errmodel_.empty() &&
+        (acceptors_.find(speller_acceptor_) == acceptors_.end()) &&
+        (errmodels_.find(speller_errmodel_) == errmodels_.end()) &&
+        (acceptor_entries_.find(speller_acceptor_) != acceptor_entries_.end()) &&
+        (errmodel_entries_.find(speller_errmodel_) != errmodel_entries_.end()))
+      {
+        // Decompress and parse the error model in another thread with its
+        // own archive handle while this one reads the dictionary
+        LoadProfile errmodel_profile;
+        std::future<Transducer*> errmodel_loading =
+            std::async(std::launch::async,
+                       [this, &errmodel_profile]()
+                       {
+                           LoadProfiler thread_profiler(&errmodel_profile);
+                           return load_transducer(
+                               errmodel_entries_[speller_errmodel_]);
+                       });
+        Transducer* acceptor = 0;
+        try
+          {
+            acceptor = load_transducer(acceptor_entries_[speller_acceptor_]);
+          }
+        catch (...)
+          {
+            try
+              {
+                delete errmodel_loading.get();
+              }
+            catch (...)
+              {
+              }
+            throw;
+          }
+        acceptors_[speller_acceptor_] = acceptor;
+        errmodels_[speller_errmodel_] = errmodel_loading.get();
+        LoadProfiler::merge(load_profile_, errmodel_profile);
+      }
+    Transducer* acceptor = get_transducer(acceptors_, acceptor_entries_,
+                                          speller_acceptor_);
+    Transducer* errmodel = 0;
+    if (!speller_errmodel_.empty())
+      {
+        errmodel = get_transducer(errmodels_, errmodel_entries_,
+                                  speller_errmodel_);
+      }
+    {
+      LoadPhaseTimer timer("speller construction");
+      current_speller_ = new Speller(errmodel, acceptor);
+      current_sugger_ = current_speller_;
+      idle_spellers_.assign(1, current_sugger_);
+      current_sugger_->set_cache_budget(cache_budget_);
+      current_sugger_->set_suffix_memo(suffix_memo_budget_,
+                                       suffix_memo_length_);
+      current_sugger_->set_node_budget(node_budget_);
+      current_sugger_->set_case_folding(case_folding_);
+      if (completion_count_ != 0)
+        {
+          current_sugger_->set_completion_count(completion_count_);
+        }
+    }
+    auto cache_entry = cache_entries_.find(speller_acceptor_);
+    if ((errmodel != 0) && (cache_entry != cache_entries_.end()))
+      {
+        // A stale or broken cache is just built again when needed
+        LoadPhaseTimer timer("cache loading");
+        try
+          {
+            std::string data = load_entry(cache_entry->second);
+            timer.add_bytes(data.size());
+            current_speller_->load_cache(data);
+          }
+        catch (ZHfstZipReadingError&)
+          {
+          }
+      }
+    auto completion_entry = completion_entries_.find(speller_acceptor_);
+    if (completion_entry != completion_entries_.end())
+      {
+        // A stale or broken index is filled again as it is used
+        LoadPhaseTimer timer("completion index loading");
+        try
+          {
+            std::string data = load_entry(completion_entry->second);
+            timer.add_bytes(data.size());
+            current_speller_->load_completions(data);
+          }
+        catch (ZHfstZipReadingError&)
+          {
+          }
+      }
+    speller_ready_ = true;
+  }
+
+void
+ZHfstOspeller::load_speller()
+  {
+    ensure_speller();
+  }
+
+void
+ZHfstOspeller::warm_cache(unsigned int threads)
+  {
+    ensure_speller();
+    if (can_correct_ && (current_sugger_ != 0))
+      {
+        std::unique_lock<std::mutex> idle = wait_until_idle();
+        LoadProfiler profiler(&load_profile_);
+        LoadPhaseTimer timer("cache warming");
+        current_sugger_->warm_cache(threads);
+        refresh_speller_copies();
+      }
+  }
+
+const LoadProfile&
+ZHfstOspeller::get_load_profile() const
+  {
+    return load_profile_;
+  }
+
+bool
+ZHfstOspeller::read_cache(const string& filename)
+  {
+    ensure_speller();
+    if (!can_correct_ || (current_sugger_ == 0))
+      {
+        return false;
+      }
+    LoadProfiler profiler(&load_profile_);
+    LoadPhaseTimer timer("cache loading");
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (f == nullptr)
+      {
+        return false;
+      }
+    std::string data;
+    char buffer[65536];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0)
+      {
+        data.append(buffer, len);
+      }
+    fclose(f);
+    timer.add_bytes(data.size());
+    std::unique_lock<std::mutex> idle = wait_until_idle();
+    bool loaded = current_sugger_->load_cache(data);
+    refresh_speller_copies();
+    return loaded;
+  }
+
+bool
+ZHfstOspeller::write_cache(const string& filename) const
+  {
+    if (!can_correct_ || !speller_ready_ || (current_sugger_ == 0))
+      {
+        return false;
+      }
+    std::string data;
+    {
+      // searches fill the cache as they go
+      std::unique_lock<std::mutex> idle = wait_until_idle();
+      data = current_sugger_->dump_cache();
+    }
+    FILE* f = fopen(filename.c_str(), "wb");
+    if (f == nullptr)
+      {
+        return false;
+      }
+    bool written = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return (fclose(f) == 0) && written;
+  }
+
+void
+ZHfstOspeller::build_completions(unsigned int depth)
+  {
+    ensure_speller();
+    if (current_speller_ == 0)
+      {
+        return;
+      }
+    LoadProfiler profiler(&load_profile_);
+    std::unique_lock<std::mutex> idle = wait_until_idle();
+    LoadPhaseTimer timer("completion index building");
+    current_speller_->build_completions(depth);
+    refresh_speller_copies();
+  }
+
+bool
+ZHfstOspeller::read_completions(const string& filename)
+  {
+    ensure_speller();
+    if (current_speller_ == 0)
+      {
+        return false;
+      }
+    LoadProfiler profiler(&load_profile_);
+    LoadPhaseTimer timer("completion index loading");
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (f == nullptr)
+      {
+        return false;
+      }
+    std::string data;
+    char buffer[65536];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0)
+      {
+        data.append(buffer, len);
+      }
+    fclose(f);
+    timer.add_bytes(data.size());
+    std::unique_lock<std::mutex> idle = wait_until_idle();
+    bool loaded = current_speller_->load_completions(data);
+    refresh_speller_copies();
+    return loaded;
+  }
+
+bool
+ZHfstOspeller::write_completions(const string& filename) const
+  {
+    if (!speller_ready_ || (current_speller_ == 0))
+      {
+        return false;
+      }
+    std::string data;
+    {
+      // complete() adds to the index as it goes
+      std::unique_lock<std::mutex> idle = wait_until_idle();
+      data = current_speller_->dump_completions();
+    }
+    FILE* f = fopen(filename.c_str(), "wb");
+    if (f == nullptr)
+      {
+        return false;
+      }
+    bool written = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return (fclose(f) == 0) && written;
+  }
+
+void
+ZHfstOspeller::set_state_tracing(bool on)
+  {
+    ensure_speller();
+    for_each_speller([on](Speller* s) { s->set_tracing(on); });
+  }
+
+bool
+ZHfstOspeller::write_state_trace(const string& filename) const
+  {
+    if (!speller_ready_ || (current_speller_ == 0))
+      {
+        return false;
+      }
+    StateTrace trace;
+    {
+      // searches count their visits as they go
+      std::unique_lock<std::mutex> idle = wait_until_idle();
+      trace = current_speller_->trace;
+      for (auto* copy : speller_copies_)
+        {
+          trace.merge(copy->trace);
+        }
+    }
+    std::string data = trace.dump();
+    FILE* f = fopen(filename.c_str(), "wb");
+    if (f == nullptr)
+      {
+        return false;
+      }
+    bool written = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return (fclose(f) == 0) && written;
+  }
+
+SearchStatistics
+ZHfstOspeller::search_statistics() const
+  {
+    SearchStatistics statistics;
+    if (current_sugger_ != 0)
+      {
+        statistics = current_sugger_->statistics;
+      }
+    for (auto* copy : speller_copies_)
+      {
+        statistics.merge(copy->statistics);
+      }
+    return statistics;
+  }
+
+MemoryReport
+ZHfstOspeller::memory_report() const
+  {
+    MemoryReport report;
+    std::set<const Transducer*> counted;
+    std::unique_lock<std::mutex> idle;
+    if (speller_ready_ && (current_sugger_ != 0))
+      {
+        idle = wait_until_idle();
+      }
+    // the sugger is always the same speller
+    if (current_speller_ != 0)
+      {
+        report = current_speller_->memory_report();
+        counted.insert(current_speller_->lexicon);
+        counted.insert(current_speller_->mutator);
+      }
+    // the copies share the automata of the sugger
+    for (auto* copy : speller_copies_)
+      {
+        report.merge(copy->memory_report(false));
+      }
+    for (auto* loaded : {&acceptors_, &errmodels_})
+      {
+        for (auto& trans : *loaded)
+          {
+            if (counted.count(trans.second) == 0)
+              {
+                trans.second->count_memory(report);
+                counted.insert(trans.second);
+              }
+          }
+      }
+    report.other += sizeof(ZHfstOspeller);
+    return report;
+  }
+
+size_t
+ZHfstOspeller::memory_growth() const
+  {
+    return memory_growth_;
+  }
+
 
 const ZHfstOspellerXmlMetadata&
 ZHfstOspeller::get_metadata() const
@@ -493,4 +1232,297 @@ ZHfstOspeller::metadata_dump() const
     return metadata_.debug_dump();
 
   }
+
+ZHfstOspellerHandle::ZHfstOspellerHandle(std::shared_ptr<ZHfstOspeller> speller,
+                                         const string& filename, Setup setup) :
+    current_(speller),
+    filename_(filename),
+    setup_(setup),
+    generation_(0)
+  {}
+
+std::shared_ptr<ZHfstOspeller>
+ZHfstOspellerHandle::get() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return current_;
+  }
+
+void
+ZHfstOspellerHandle::reload(const string& filename)
+  {
+    std::lock_guard<std::mutex> reloading(reload_mutex_);
+    string path = filename;
+    if (path == "")
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        path = filename_;
+      }
+    std::shared_ptr<ZHfstOspeller> fresh = std::make_shared<ZHfstOspeller>();
+    fresh->read_zhfst(path);
+    if (setup_)
+      {
+        setup_(*fresh);
+      }
+    // nothing is left to load on the first search
+    fresh->load_speller();
+    std::shared_ptr<ZHfstOspeller> old;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      old.swap(current_);
+      current_ = fresh;
+      filename_ = path;
+      ++generation_;
+    }
+    // the old speller is freed here unless searches still hold it
+  }
+
+std::future<void>
+ZHfstOspellerHandle::reload_in_background(const string& filename)
+  {
+    return std::async(std::launch::async,
+                      [this, filename]() { reload(filename); });
+  }
+
+unsigned long
+ZHfstOspellerHandle::generation() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return generation_;
+  }
+
+ZHfstOspellerSet::ZHfstOspellerSet(size_t memory_limit, Setup setup) :
+    memory_limit_(memory_limit),
+    memory_used_(0),
+    setup_(setup),
+    clock_(0)
+  {}
+
+string
+ZHfstOspellerSet::add(const string& filename)
+  {
+    // only the metadata is read here, the speller is loaded on first use
+    ZHfstOspeller archive;
+    archive.read_zhfst(filename);
+    string locale = archive.get_metadata().info_.locale_;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = languages_.find(locale);
+    if (found != languages_.end())
+      {
+        throw ZHfstMetaDataParsingError("locale " + locale +
+                                        " is already served by " +
+                                        found->second.filename);
+      }
+    Language& language = languages_[locale];
+    language.filename = filename;
+    language.last_used = 0;
+    language.bytes = 0;
+    language.growth = 0;
+    language.loading = std::make_shared<std::mutex>();
+    return locale;
+  }
+
+std::vector<string>
+ZHfstOspellerSet::locales() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<string> result;
+    for (auto& language : languages_)
+      {
+        result.push_back(language.first);
+      }
+    return result;
+  }
+
+bool
+ZHfstOspellerSet::has_locale(const string& locale) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return languages_.count(locale) != 0;
+  }
+
+bool
+ZHfstOspellerSet::is_loaded(const string& locale) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = languages_.find(locale);
+    return (found != languages_.end()) && found->second.speller;
+  }
+
+std::shared_ptr<ZHfstOspeller>
+ZHfstOspellerSet::load(const string& filename)
+  {
+    std::shared_ptr<ZHfstOspeller> speller = std::make_shared<ZHfstOspeller>();
+    speller->read_zhfst(filename);
+    if (setup_)
+      {
+        setup_(*speller);
+      }
+    speller->load_speller();
+    return speller;
+  }
+
+void
+ZHfstOspellerSet::install(Language& language,
+                          std::shared_ptr<ZHfstOspeller> speller, size_t bytes)
+  {
+    if (language.speller)
+      {
+        memory_used_ -= language.bytes;
+      }
+    language.speller = speller;
+    language.bytes = bytes;
+    language.growth = speller->memory_growth();
+    memory_used_ += bytes;
+  }
+
+void
+ZHfstOspellerSet::remeasure(Language& language)
+  {
+    size_t growth = language.speller->memory_growth();
+    // both differences wrap around alike when the caches shrank
+    memory_used_ += growth - language.growth;
+    language.bytes += growth - language.growth;
+    language.growth = growth;
+  }
+
+void
+ZHfstOspellerSet::enforce_memory_limit(
+    const Language* keep,
+    std::vector<std::shared_ptr<ZHfstOspeller> >& unloaded)
+  {
+    while ((memory_limit_ != 0) && (memory_used_ > memory_limit_))
+      {
+        Language* oldest = 0;
+        for (auto& entry : languages_)
+          {
+            Language& language = entry.second;
+            if (language.speller && (&language != keep) &&
+                ((oldest == 0) || (language.last_used < oldest->last_used)))
+              {
+                oldest = &language;
+              }
+          }
+        if (oldest == 0)
+          {
+            break;
+          }
+        memory_used_ -= oldest->bytes;
+        oldest->bytes = 0;
+        unloaded.push_back(oldest->speller);
+        oldest->speller.reset();
+      }
+  }
+
+std::shared_ptr<ZHfstOspeller>
+ZHfstOspellerSet::get(const string& locale)
+  {
+    std::shared_ptr<std::mutex> loading;
+    string filename;
+    // unloaded spellers are freed after the lock is let go
+    std::vector<std::shared_ptr<ZHfstOspeller> > unloaded;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto found = languages_.find(locale);
+      if (found == languages_.end())
+        {
+          return std::shared_ptr<ZHfstOspeller>();
+        }
+      found->second.last_used = ++clock_;
+      if (found->second.speller)
+        {
+          // the searches since the last get() may have grown its caches
+          remeasure(found->second);
+          enforce_memory_limit(&found->second, unloaded);
+          return found->second.speller;
+        }
+      loading = found->second.loading;
+      filename = found->second.filename;
+    }
+    // other languages can be used while this one loads, and other callers
+    // of this one wait for it
+    std::lock_guard<std::mutex> loading_lock(*loading);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      Language& language = languages_.find(locale)->second;
+      if (language.speller)
+        {
+          return language.speller;
+        }
+    }
+    std::shared_ptr<ZHfstOspeller> speller = load(filename);
+    size_t bytes = speller->memory_report().total();
+    std::lock_guard<std::mutex> lock(mutex_);
+    Language& language = languages_.find(locale)->second;
+    install(language, speller, bytes);
+    enforce_memory_limit(&language, unloaded);
+    return speller;
+  }
+
+bool
+ZHfstOspellerSet::spell(const string& locale, const string& wordform)
+  {
+    std::shared_ptr<ZHfstOspeller> speller = get(locale);
+    return speller && speller->spell(wordform);
+  }
+
+CorrectionQueue
+ZHfstOspellerSet::suggest(const string& locale, const string& wordform)
+  {
+    std::shared_ptr<ZHfstOspeller> speller = get(locale);
+    if (!speller)
+      {
+        return CorrectionQueue();
+      }
+    return speller->suggest(wordform);
+  }
+
+void
+ZHfstOspellerSet::set_memory_limit(size_t bytes)
+  {
+    std::vector<std::shared_ptr<ZHfstOspeller> > unloaded;
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_limit_ = bytes;
+    enforce_memory_limit(0, unloaded);
+  }
+
+size_t
+ZHfstOspellerSet::memory_used() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memory_used_;
+  }
+
+void
+ZHfstOspellerSet::reload()
+  {
+    for (auto& locale : locales())
+      {
+        std::shared_ptr<std::mutex> loading;
+        string filename;
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          Language& language = languages_.find(locale)->second;
+          if (!language.speller)
+            {
+              // read again anyway when it is next used
+              continue;
+            }
+          loading = language.loading;
+          filename = language.filename;
+        }
+        std::lock_guard<std::mutex> loading_lock(*loading);
+        std::shared_ptr<ZHfstOspeller> speller = load(filename);
+        size_t bytes = speller->memory_report().total();
+        std::vector<std::shared_ptr<ZHfstOspeller> > unloaded;
+        std::lock_guard<std::mutex> lock(mutex_);
+        Language& language = languages_.find(locale)->second;
+        if (language.speller)
+          {
+            unloaded.push_back(language.speller);
+            install(language, speller, bytes);
+            enforce_memory_limit(&language, unloaded);
+          }
+      }
+  }
 } // namespace hfst_ospell
@@ -36,6 +36,14 @@
 
 #include <stdexcept>
 #include <map>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <shared_mutex>
+#include <condition_variable>
+#include <memory>
+#include <future>
 
 #include "ospell.h"
 #include "hfst-ol.h"
@@ -67,15 +75,143 @@ namespace hfst_ospell
             OSPELL_API void set_beam(Weight beam);
             //! @brief set time cutoff for correcting
             OSPELL_API void set_time_cutoff(float time_cutoff);
+            //! @brief decompress and parse the dictionary and the error
+            //!        model concurrently when the speller is built.
+            OSPELL_API void set_parallel_loading(bool parallel);
+            //! @brief limit the memory used for caching corrections to
+            //!        @a bytes, or no limit if 0.
+            //!
+            //! The least used entries get dropped and are built again if
+            //! needed.
+            OSPELL_API void set_cache_budget(size_t bytes);
+            //! @brief remember the corrections of the last @a length
+            //!        symbols of words across suggestions in at most
+            //!        @a bytes, or not at all if 0.
+            OSPELL_API void set_suffix_memo(size_t bytes,
+                                            unsigned int length = 4);
+            //! @brief stop each suggestion search after expanding @a nodes
+            //!        search nodes, or never if 0.
+            //!
+            //! The best suggestions found so far are given, and
+            //! suggestions_truncated() tells whether the search stopped.
+            //! Unlike set_time_cutoff(), this gives the same suggestions
+            //! for a word on any machine and under any load.
+            OSPELL_API void set_node_budget(unsigned long nodes);
+            //! @brief accept and correct word forms written with other
+            //!        cases of the letters of the dictionary.
+            //!
+            //! Corrections are capitalized like the misspelling was.
+            //! Only letters with a single code point for each case are
+            //! folded, like those of the Latin, Greek, Cyrillic and
+            //! Armenian alphabets.
+            OSPELL_API void set_case_folding(bool on);
+            //! @brief load the speller and let @a searches threads check
+            //!        and correct with it at the same time.
+            //!
+            //! Each search gets its own copy of the search state and
+            //! caches, and the automata are shared. Without this, calls
+            //! from several threads are served one at a time. Waits for
+            //! the searches running in other threads to finish first.
+            OSPELL_API void set_concurrency(unsigned int searches);
             //! @brief construct speller from named file containing valid
             //!        zhfst archive.
+            //!
+            //! Only the metadata is parsed here, the automata are listed and
+            //! extracted from the archive when a speller first needs them.
+            //! They are only extracted from the same file: if another has
+            //! been put in its place by then, ZHfstZipReadingError is
+            //! thrown. Use load_speller() to get any such error here
+            //! instead of from the first search.
             OSPELL_API void read_zhfst(const std::string& filename);
+            //! @brief extract and parse the automata of the default speller
+            //!        now instead of on first use.
+            OSPELL_API void load_speller();
+            //! @brief load the speller and build its correction cache for
+            //!        every error model symbol using @a threads threads, or
+            //!        one per core if 0.
+            //!
+            //! Searches from other threads wait until it is done.
+            OSPELL_API void warm_cache(unsigned int threads = 0);
+            //! @brief load the correction cache from a file written by
+            //!        write_cache().
+            //!
+            //! Returns false if the file cannot be read or was written for
+            //! other automata. A cache stored in the archive as
+            //! cache.DESCRIPTION.bin is read the same way when the speller
+            //! using acceptor.DESCRIPTION is loaded.
+            OSPELL_API bool read_cache(const std::string& filename);
+            //! @brief write the correction cache built so far to a file,
+            //!        once no search is filling it.
+            OSPELL_API bool write_cache(const std::string& filename) const;
+            //! @brief load the speller and fill its completion index for
+            //!        all prefixes of up to @a depth symbols.
+            //!
+            //! Without this the completions of the states complete()
+            //! reaches are searched then, and only the latest ones kept.
+            OSPELL_API void build_completions(unsigned int depth);
+            //! @brief keep @a count completions per state in the index
+            //!        built from now on, which drops the index built so far
+            //!        if that changes.
+            //!
+            //! An index read from a file or the archive keeps as many as
+            //! it was built with.
+            OSPELL_API void set_completion_count(unsigned int count);
+            //! @brief load the completion index from a file written by
+            //!        write_completions().
+            //!
+            //! Returns false if the file cannot be read or was written for
+            //! another dictionary. An index stored in the archive as
+            //! completions.DESCRIPTION.bin is read the same way when the
+            //! speller using acceptor.DESCRIPTION is loaded.
+            OSPELL_API bool read_completions(const std::string& filename);
+            //! @brief write the completion index filled so far to a file,
+            //!        once no search is filling it.
+            OSPELL_API bool write_completions(const std::string& filename)
+                const;
+            //! @brief load the speller and start or stop counting the
+            //!        states its searches visit.
+            OSPELL_API void set_state_tracing(bool on);
+            //! @brief write the state visits counted so far to a file for
+            //!        hfst-ospell-optimize, once no search is counting.
+            OSPELL_API bool write_state_trace(const std::string& filename) const;
 
             //! @brief  check if the given word is spelled correctly
+            //!
+            //! May throw ZHfstZipReadingError if the automata cannot be
+            //! extracted when they are first needed.
             OSPELL_API bool spell(const std::string& wordform);
             //! @brief construct an ordered set of corrections for misspelled
             //!        word form.
             OSPELL_API CorrectionQueue suggest(const std::string& wordform);
+            //! @brief correct several spellings of one word form, such as
+            //!        with and without punctuation or capitals, in one
+            //!        search.
+            //!
+            //! Corrections of @a wordforms[i] weigh @a offsets[i], or
+            //! nothing if there are fewer offsets, more, and only the best
+            //! ones of all the spellings are given.
+            //! @return the corrections of each word form, by word form
+            OSPELL_API std::vector<CorrectionQueue> suggest(
+                const std::vector<std::string>& wordforms,
+                const std::vector<Weight>& offsets);
+            //! @brief correct a word form as it is typed, going on from the
+            //!        search @a session kept for the word form before.
+            //!
+            //! Suggestions are as for the one word form, except that the
+            //! time cutoff is not used. A session must not be used by two
+            //! threads at once.
+            OSPELL_API CorrectionQueue suggest(CorrectionSession& session,
+                                               const std::string& wordform);
+            //! @brief whether the last suggest() in this thread stopped at
+            //!        its time cutoff or node budget before searching
+            //!        everything.
+            OSPELL_API bool suggestions_truncated() const;
+            //! @brief give the cheapest words of the dictionary that start
+            //!        with @a prefix, without the error model.
+            //!
+            //! As many are given as the queue limit, or 10 if it is not
+            //! set, and none weighing more than the weight limit.
+            OSPELL_API CorrectionQueue complete(const std::string& prefix);
             //! @brief analyse word form morphologically
             //! @param wordform   the string to analyse
             //! @param ask_sugger whether to use the spelling correction model
@@ -98,12 +234,65 @@ namespace hfst_ospell
 
             //! @brief get access to metadata read from XML.
             const ZHfstOspellerXmlMetadata& get_metadata() const;
+            //! @brief get time and bytes spent in each phase of loading
+            //!        the archive and its automata so far.
+            OSPELL_API const LoadProfile& get_load_profile() const;
+            //! @brief count the bytes held by the loaded automata, the
+            //!        speller, its copies and their caches, once none of
+            //!        them is searching.
+            OSPELL_API MemoryReport memory_report() const;
+            //! @brief bytes the searches so far have added to the caches
+            //!        and suffix memos of the speller and its copies, less
+            //!        what they dropped, modulo the range of size_t.
+            OSPELL_API size_t memory_growth() const;
+            //! @brief what the searches of the speller and its copies have
+            //!        done so far; should not be called while they search.
+            OSPELL_API SearchStatistics search_statistics() const;
             //! @brief create string representation of the speller for
             //!        programmer to debug
             std::string metadata_dump() const;
         private:
+            //! @brief extract and parse the automaton in archive entry
+            //!        @a pathname.
+            Transducer* load_transducer(const std::string& pathname);
+            //! @brief extract archive entry @a pathname into memory.
+            std::string load_entry(const std::string& pathname);
+            //! @brief get automaton @a descr from @a loaded or load it from
+            //!        the archive entry listed in @a entries.
+            Transducer* get_transducer(
+                std::map<std::string, Transducer*>& loaded,
+                const std::map<std::string, std::string>& entries,
+                const std::string& descr);
+            //! @brief build the speller and sugger on first use, once
+            //!        even if several threads ask at the same time.
+            void ensure_speller();
+            //! @brief run @a search for @a wordform with an idle copy of
+            //!        the speller, or return @a none if there is no speller.
+            template <typename Result>
+            Result with_speller(const std::string& wordform, Result none,
+                                std::function<Result(Speller*, char*)> search);
+            //! @brief run @a search for the @a count word forms at
+            //!        @a wordforms like with_speller() does for one.
+            template <typename Result>
+            Result with_speller(const std::string* wordforms, size_t count,
+                                Result none,
+                                std::function<Result(Speller*, char**)>
+                                search);
+            //! @brief apply @a change to the speller and all its copies
+            //!        once none of them is searching.
+            void for_each_speller(std::function<void(Speller*)> change);
+            //! @brief wait until the sugger and all its copies are idle,
+            //!        and keep searches from taking them while the lock
+            //!        returned is held.
+            std::unique_lock<std::mutex> wait_until_idle() const;
+            //! @brief make the copies of the sugger like it again, after
+            //!        its cache has been filled, holding wait_until_idle().
+            void refresh_speller_copies();
             //! @brief file or path where the speller came from
             std::string filename_;
+            //! @brief device, inode, size and time of filename_ when its
+            //!        metadata was read
+            std::string archive_identity_;
             //! @brief upper bound for suggestions generated and given
             unsigned long suggestions_maximum_;
             //! @brief upper bound for suggestion weight generated and given
@@ -124,10 +313,36 @@ namespace hfst_ospell
             //! @brief whether automatons loaded yet can be used to hyphenate
             //!        word forms
             bool can_hyphenate_;
+            //! @brief whether automata are loaded in parallel threads
+            bool parallel_loading_;
+            //! @brief bytes the correction cache may use, or 0
+            size_t cache_budget_;
+            //! @brief bytes the suffix memo may use, or 0 for none
+            size_t suffix_memo_budget_;
+            //! @brief longest word ending kept in the suffix memo
+            unsigned int suffix_memo_length_;
+            //! @brief search nodes expanded per suggestion, or 0
+            unsigned long node_budget_;
+            //! @brief completions kept per state, or 0 for the default
+            unsigned int completion_count_;
+            //! @brief whether the case of letters is ignored
+            bool case_folding_;
             //! @brief dictionaries loaded
             std::map<std::string, Transducer*> acceptors_;
             //! @brief error models loaded
             std::map<std::string, Transducer*> errmodels_;
+            //! @brief archive entries of dictionaries by description
+            std::map<std::string, std::string> acceptor_entries_;
+            //! @brief archive entries of error models by description
+            std::map<std::string, std::string> errmodel_entries_;
+            //! @brief archive entries of correction caches by description
+            std::map<std::string, std::string> cache_entries_;
+            //! @brief archive entries of completion indexes by description
+            std::map<std::string, std::string> completion_entries_;
+            //! @brief description of dictionary used for the speller
+            std::string speller_acceptor_;
+            //! @brief description of error model used for the speller
+            std::string speller_errmodel_;
             //! @brief pointer to current speller
             Speller* current_speller_;
             //! @brief pointer to current correction model
@@ -136,8 +351,165 @@ namespace hfst_ospell
             Speller* current_analyser_;
             //! @brief pointer to current hyphenator
             Transducer* current_hyphenator_;
+            //! @brief copies of the sugger made by set_concurrency()
+            std::vector<Speller*> speller_copies_;
+            //! @brief the sugger and its copies that are not searching
+            std::vector<Speller*> idle_spellers_;
+            //! @brief guards idle_spellers_
+            mutable std::mutex idle_mutex_;
+            //! @brief signalled when a speller becomes idle
+            mutable std::condition_variable speller_idle_;
+            //! @brief what memory_growth() returns
+            std::atomic<size_t> memory_growth_;
+            //! @brief held while the speller is being built
+            std::mutex load_mutex_;
+            //! @brief whether ensure_speller() has nothing left to do
+            std::atomic<bool> speller_ready_;
+            //! @brief held shared by searches and exclusively by a search
+            //!        whose input adds symbols to the shared automata
+            std::shared_mutex symbols_mutex_;
             //! @brief the metadata of loaded speller
             ZHfstOspellerXmlMetadata metadata_;
+            //! @brief phases of loading done so far
+            LoadProfile load_profile_;
+      };
+
+    //! @brief A ZHfstOspeller behind a reference counted handle, which can
+    //!        be replaced by a newly read archive while it is in use.
+    //!
+    //! Searches hold on to the speller they got from get(), so they finish
+    //! with the old speller after a reload, and it is freed when the last
+    //! of them lets go.
+    class ZHfstOspellerHandle
+      {
+        public:
+            //! @brief sets the options of and warms each speller read
+            //!        by reload() before it is used.
+            typedef std::function<void(ZHfstOspeller&)> Setup;
+            //! @brief hand out @a speller, read from @a filename, and set
+            //!        up spellers read later with @a setup.
+            OSPELL_API ZHfstOspellerHandle(std::shared_ptr<ZHfstOspeller>
+                                           speller,
+                                           const std::string& filename,
+                                           Setup setup = Setup());
+            //! @brief the speller in use, kept alive while it is held.
+            OSPELL_API std::shared_ptr<ZHfstOspeller> get() const;
+            //! @brief read @a filename, or the file read last if empty,
+            //!        load and set up its speller and then use it.
+            //!
+            //! Throws like read_zhfst() and keeps the old speller if the
+            //! new one cannot be loaded. Reloads are done one at a time.
+            OSPELL_API void reload(const std::string& filename = "");
+            //! @brief reload() in a new thread; the future gives any error.
+            OSPELL_API std::future<void> reload_in_background(
+                const std::string& filename = "");
+            //! @brief how many times a new speller has been swapped in.
+            OSPELL_API unsigned long generation() const;
+        private:
+            //! @brief guards current_, filename_ and generation_
+            mutable std::mutex mutex_;
+            //! @brief held while a new speller is being read
+            std::mutex reload_mutex_;
+            //! @brief the speller handed out
+            std::shared_ptr<ZHfstOspeller> current_;
+            //! @brief file of the speller handed out
+            std::string filename_;
+            //! @brief applied to each newly read speller
+            Setup setup_;
+            //! @brief spellers swapped in so far
+            unsigned long generation_;
+      };
+
+    //! @brief Spellers of many languages keyed by the locale in their
+    //!        archives' metadata, loaded on first use and unloaded, least
+    //!        recently used first, when they take more memory together
+    //!        than allowed.
+    class ZHfstOspellerSet
+      {
+        public:
+            typedef ZHfstOspellerHandle::Setup Setup;
+            //! @brief keep the loaded spellers under @a memory_limit bytes,
+            //!        or any size if 0, and set up each one with @a setup
+            //!        when it is loaded.
+            OSPELL_API ZHfstOspellerSet(size_t memory_limit = 0,
+                                        Setup setup = Setup());
+            //! @brief read the metadata of the archive @a filename and
+            //!        serve its locale with it.
+            //!
+            //! Throws like read_zhfst(), and ZHfstMetaDataParsingError if
+            //! another archive already has the same locale.
+            //! @return the locale of the archive
+            OSPELL_API std::string add(const std::string& filename);
+            //! @brief locales served, in order.
+            OSPELL_API std::vector<std::string> locales() const;
+            //! @brief whether an archive has been added for @a locale.
+            OSPELL_API bool has_locale(const std::string& locale) const;
+            //! @brief whether the speller of @a locale is loaded now.
+            OSPELL_API bool is_loaded(const std::string& locale) const;
+            //! @brief the speller of @a locale, loaded if needed, or null
+            //!        if there is none.
+            //!
+            //! The speller stays alive while it is held, even if it is
+            //! unloaded from the set meanwhile.
+            OSPELL_API std::shared_ptr<ZHfstOspeller> get(
+                const std::string& locale);
+            //! @brief check @a wordform with the speller of @a locale.
+            OSPELL_API bool spell(const std::string& locale,
+                                  const std::string& wordform);
+            //! @brief correct @a wordform with the speller of @a locale.
+            OSPELL_API CorrectionQueue suggest(const std::string& locale,
+                                               const std::string& wordform);
+            //! @brief unload spellers until the loaded ones take at most
+            //!        @a bytes, or never if 0.
+            OSPELL_API void set_memory_limit(size_t bytes);
+            //! @brief bytes taken by the loaded spellers when they were
+            //!        last got.
+            OSPELL_API size_t memory_used() const;
+            //! @brief read the archives of the loaded spellers again and
+            //!        switch to them once each is set up.
+            //!
+            //! Throws like read_zhfst() and keeps the old speller of the
+            //! archive that failed and those after it.
+            OSPELL_API void reload();
+        private:
+            //! @brief one archive and its speller if loaded
+            struct Language
+              {
+                std::string filename; //!< archive of the language
+                std::shared_ptr<ZHfstOspeller> speller; //!< null if unloaded
+                unsigned long last_used; //!< clock_ at last get()
+                size_t bytes; //!< memory of speller at last get()
+                size_t growth; //!< its memory_growth() when bytes was set
+                std::shared_ptr<std::mutex> loading; //!< held while loading
+              };
+            //! @brief read, set up and load the archive @a filename.
+            std::shared_ptr<ZHfstOspeller> load(const std::string& filename);
+            //! @brief make @a speller of @a bytes the speller of
+            //!        @a language, holding mutex_.
+            void install(Language& language,
+                         std::shared_ptr<ZHfstOspeller> speller,
+                         size_t bytes);
+            //! @brief add what the searches have grown the caches of the
+            //!        speller of @a language by since it was last
+            //!        measured, holding mutex_.
+            void remeasure(Language& language);
+            //! @brief move the least recently used spellers but @a keep to
+            //!        @a unloaded while over memory_limit_, holding mutex_.
+            void enforce_memory_limit(
+                const Language* keep,
+                std::vector<std::shared_ptr<ZHfstOspeller> >& unloaded);
+            //! @brief guards all but the spellers themselves
+            mutable std::mutex mutex_;
+            //! @brief the archives by locale
+            std::map<std::string, Language> languages_;
+            //! @brief bytes the loaded spellers may take, or 0
+            size_t memory_limit_;
+            //! @brief bytes the loaded spellers take
+            size_t memory_used_;
+            //! @brief applied to each speller loaded
+            Setup setup_;
+            //! @brief counts get() calls, to find the least recently used
+            unsigned long clock_;
       };
 
     //! @brief Top-level exception for zhfst handling.
@@ -0,0 +1,333 @@
+/* -*- Mode: C++ -*- */
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <unordered_map>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+#include "document.h"
+
+namespace hfst_ospell
+  {
+
+//! what a byte can be in running text
+enum ByteClass
+  {
+    SEPARATOR, //!< ends a word
+    LETTER, //!< ASCII letter
+    DIGIT, //!< ASCII digit
+    JOINER, //!< apostrophe or hyphen, part of a word between letters
+    MULTIBYTE //!< starts a longer UTF-8 character
+  };
+
+static ByteClass
+classify(unsigned char c)
+  {
+    if (((c | 0x20) >= 'a') && ((c | 0x20) <= 'z'))
+      {
+        return LETTER;
+      }
+    if ((c >= '0') && (c <= '9'))
+      {
+        return DIGIT;
+      }
+    if ((c == '\'') || (c == '-'))
+      {
+        return JOINER;
+      }
+    if (c >= 0xC2 && c <= 0xF4)
+      {
+        return MULTIBYTE;
+      }
+    return SEPARATOR;
+  }
+
+//! classes of all bytes, built once
+struct ByteClasses
+  {
+    ByteClass classes[256];
+    ByteClasses()
+      {
+        for (int c = 0; c < 256; ++c)
+          {
+            classes[c] = classify(static_cast<unsigned char>(c));
+          }
+      }
+  };
+
+static const ByteClasses byte_classes;
+
+//! decode the UTF-8 character at @a i, 0 if it is not valid
+static unsigned int
+decode_utf8(const std::string& text, size_t i, size_t& length)
+  {
+    unsigned char c = text[i];
+    unsigned int code;
+    if (c >= 0xF0)
+      {
+        length = 4;
+        code = c & 0x07;
+      }
+    else if (c >= 0xE0)
+      {
+        length = 3;
+        code = c & 0x0F;
+      }
+    else
+      {
+        length = 2;
+        code = c & 0x1F;
+      }
+    if (i + length > text.size())
+      {
+        return 0;
+      }
+    for (size_t k = 1; k < length; ++k)
+      {
+        unsigned char next = text[i + k];
+        if ((next & 0xC0) != 0x80)
+          {
+            return 0;
+          }
+        code = (code << 6) | (next & 0x3F);
+      }
+    return code;
+  }
+
+//! whether code point @a code is punctuation or space rather than a letter
+static bool
+is_separator_code(unsigned int code)
+  {
+    return (code >= 0x00A0 && code <= 0x00BF) || (code == 0x00D7) ||
+        (code == 0x00F7) || (code >= 0x2000 && code <= 0x206F) ||
+        (code >= 0x2E00 && code <= 0x2E7F) ||
+        (code >= 0x3000 && code <= 0x303F) ||
+        (code >= 0xFE30 && code <= 0xFE4F) ||
+        (code >= 0xFF01 && code <= 0xFF0F) || (code == 0xFEFF);
+  }
+
+//! number of ASCII letters starting at @a i
+static size_t
+letter_run(const std::string& text, size_t i)
+  {
+    size_t start = i;
+#ifdef __SSE2__
+    // Compare 16 bytes at a time: a byte is a letter if, lowercased, it is
+    // within 'a'..'z'; bytes over 127 are negative and never match
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i before_a = _mm_set1_epi8('a' - 1);
+    const __m128i after_z = _mm_set1_epi8('z' + 1);
+    while (i + 16 <= text.size())
+      {
+        __m128i bytes = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(text.data() + i));
+        bytes = _mm_or_si128(bytes, lower);
+        __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(bytes, before_a),
+                                        _mm_cmplt_epi8(bytes, after_z));
+        unsigned int mask = _mm_movemask_epi8(letters);
+        if (mask != 0xFFFF)
+          {
+            return i - start + __builtin_ctz(~mask);
+          }
+        i += 16;
+      }
+#endif
+    while ((i < text.size()) &&
+           (byte_classes.classes[static_cast<unsigned char>(text[i])] ==
+            LETTER))
+      {
+        ++i;
+      }
+    return i - start;
+  }
+
+//! length of the word character at @a i, or 0 if it is not one
+static size_t
+word_char(const std::string& text, size_t i, bool& digit)
+  {
+    if (i >= text.size())
+      {
+        return 0;
+      }
+    switch (byte_classes.classes[static_cast<unsigned char>(text[i])])
+      {
+      case LETTER:
+        return 1;
+      case DIGIT:
+        digit = true;
+        return 1;
+      case MULTIBYTE:
+        {
+          size_t length;
+          unsigned int code = decode_utf8(text, i, length);
+          if ((code == 0) || is_separator_code(code))
+            {
+              return 0;
+            }
+          return length;
+        }
+      default:
+        return 0;
+      }
+  }
+
+//! length of the joiner at @a i, or 0 if it is not one
+static size_t
+joiner(const std::string& text, size_t i)
+  {
+    if (byte_classes.classes[static_cast<unsigned char>(text[i])] == JOINER)
+      {
+        return 1;
+      }
+    // right single quotation mark, often used as an apostrophe
+    if (text.compare(i, 3, "\xE2\x80\x99") == 0)
+      {
+        return 3;
+      }
+    return 0;
+  }
+
+std::vector<DocumentToken>
+tokenize_document(const std::string& text)
+  {
+    std::vector<DocumentToken> tokens;
+    size_t i = 0;
+    while (i < text.size())
+      {
+        bool digit = false;
+        size_t length = word_char(text, i, digit);
+        if (length == 0)
+          {
+            ++i;
+            while ((i < text.size()) &&
+                   ((static_cast<unsigned char>(text[i]) & 0xC0) == 0x80))
+              {
+                ++i;
+              }
+            continue;
+          }
+        size_t start = i;
+        i += length;
+        while (i < text.size())
+          {
+            size_t run = letter_run(text, i);
+            if (run > 0)
+              {
+                i += run;
+                continue;
+              }
+            length = word_char(text, i, digit);
+            if (length == 0)
+              {
+                size_t join = joiner(text, i);
+                bool next_digit = false;
+                if ((join > 0) && (word_char(text, i + join, next_digit) > 0))
+                  {
+                    i += join;
+                    continue;
+                  }
+                break;
+              }
+            i += length;
+          }
+        if (!digit)
+          {
+            DocumentToken token = {start, i - start};
+            tokens.push_back(token);
+          }
+      }
+    return tokens;
+  }
+
+std::vector<DocumentError>
+spell_document(ZHfstOspeller& speller, const std::string& text, bool suggest,
+               unsigned int jobs)
+  {
+    std::vector<DocumentToken> tokens = tokenize_document(text);
+    // every distinct word is looked at only once
+    std::unordered_map<std::string, size_t> word_numbers;
+    std::vector<std::string> words;
+    std::vector<size_t> token_words;
+    token_words.reserve(tokens.size());
+    for (auto& token : tokens)
+      {
+        auto inserted = word_numbers.insert(
+            std::make_pair(text.substr(token.offset, token.length),
+                           words.size()));
+        if (inserted.second)
+          {
+            words.push_back(inserted.first->first);
+          }
+        token_words.push_back(inserted.first->second);
+      }
+    std::vector<char> correct(words.size(), 1);
+    std::vector<std::vector<std::string> > suggestions(words.size());
+    auto check = [&](size_t first, size_t step)
+      {
+        for (size_t w = first; w < words.size(); w += step)
+          {
+            correct[w] = speller.spell(words[w]);
+            if (!correct[w] && suggest)
+              {
+                CorrectionQueue corrections = speller.suggest(words[w]);
+                while (corrections.size() > 0)
+                  {
+                    suggestions[w].push_back(corrections.top().first);
+                    corrections.pop();
+                  }
+              }
+          }
+      };
+    if ((jobs > 1) && (words.size() > 1))
+      {
+        speller.set_concurrency(jobs);
+        std::vector<std::thread> threads;
+        for (unsigned int j = 0; j < jobs; ++j)
+          {
+            threads.push_back(std::thread(check, j, jobs));
+          }
+        for (auto& thread : threads)
+          {
+            thread.join();
+          }
+      }
+    else
+      {
+        check(0, 1);
+      }
+    std::vector<DocumentError> errors;
+    for (size_t t = 0; t < tokens.size(); ++t)
+      {
+        size_t w = token_words[t];
+        if (!correct[w])
+          {
+            DocumentError error = {tokens[t].offset, words[w],
+                                   suggestions[w]};
+            errors.push_back(error);
+          }
+      }
+    return errors;
+  }
+
+  } // namespace hfst_ospell
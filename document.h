@@ -0,0 +1,59 @@
+/* -*- Mode: C++ -*- */
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef HFST_OSPELL_DOCUMENT_H_
+#define HFST_OSPELL_DOCUMENT_H_ 1
+
+#include <string>
+#include <vector>
+
+#include "ZHfstOspeller.h"
+
+namespace hfst_ospell
+  {
+    //! @brief A word found in running text.
+    struct DocumentToken
+      {
+        size_t offset; //!< byte offset of the word in the text
+        size_t length; //!< length of the word in bytes
+      };
+
+    //! @brief A misspelled word in running text.
+    struct DocumentError
+      {
+        size_t offset; //!< byte offset of the word in the text
+        std::string word; //!< the word as written
+        std::vector<std::string> suggestions; //!< corrections, best first
+      };
+
+    //! @brief find the words of the UTF-8 @a text.
+    //!
+    //! Words are runs of letters and digits, joined by apostrophes or
+    //! hyphens between them. Words with digits are left out, as are
+    //! bytes that are not valid UTF-8.
+    std::vector<DocumentToken> tokenize_document(const std::string& text);
+
+    //! @brief check every word of the UTF-8 @a text with @a speller.
+    //!
+    //! Each distinct word is checked and, if @a suggest, corrected only
+    //! once, by @a jobs threads if more than one.
+    //! @return the misspelled words in the order they occur in @a text.
+    std::vector<DocumentError> spell_document(ZHfstOspeller& speller,
+                                              const std::string& text,
+                                              bool suggest,
+                                              unsigned int jobs);
+  } // namespace hfst_ospell
+
+#endif // HFST_OSPELL_DOCUMENT_H_
@@ -14,6 +14,8 @@
 
 #include "hfst-ol.h"
 #include <string>
+#include <chrono>
+#include <algorithm>
 #if HAVE_CONFIG_H
 #  include <config.h>
 #endif
@@ -36,6 +38,85 @@ void skip_c_string(char ** raw)
     ++(*raw);
 }
 
+uint64_t hash_bytes(const void * data, size_t len, uint64_t hash)
+{
+    const unsigned char * bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+size_t string_heap_size(const std::string & s)
+{
+    const char * data = s.data();
+    if (data >= reinterpret_cast<const char *>(&s) &&
+        data < reinterpret_cast<const char *>(&s + 1)) {
+        // short string stored inside the object itself
+        return 0;
+    }
+    return s.capacity() + 1;
+}
+
+static thread_local LoadProfile * active_load_profile = NULL;
+
+static double seconds_now()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LoadProfiler::LoadProfiler(LoadProfile * profile):
+    previous(active_load_profile)
+{
+    active_load_profile = profile;
+}
+
+LoadProfiler::~LoadProfiler()
+{
+    active_load_profile = previous;
+}
+
+void LoadProfiler::add(const char * name, double seconds, size_t bytes)
+{
+    if (active_load_profile == NULL) {
+        return;
+    }
+    LoadPhase phase = {name, seconds, bytes, 1};
+    merge(*active_load_profile, LoadProfile(1, phase));
+}
+
+void LoadProfiler::merge(LoadProfile & to, const LoadProfile & from)
+{
+    for (auto& phase : from) {
+        bool found = false;
+        for (auto& existing : to) {
+            if (existing.name == phase.name) {
+                existing.seconds += phase.seconds;
+                existing.bytes += phase.bytes;
+                existing.count += phase.count;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            to.push_back(phase);
+        }
+    }
+}
+
+LoadPhaseTimer::LoadPhaseTimer(const char * phase_name):
+    name(phase_name),
+    bytes(0),
+    start(seconds_now())
+{}
+
+LoadPhaseTimer::~LoadPhaseTimer()
+{
+    LoadProfiler::add(name, seconds_now() - start, bytes);
+}
+
 bool is_big_endian()
 {
 #ifdef WORDS_BIGENDIAN
@@ -187,6 +268,7 @@ void TransducerHeader::skip_hfst3_header(FILE * f)
             HFSTOSPELL_THROW_MESSAGE(HeaderParsingException,
                                "Found broken HFST3 header\n");
         }
+        parse_hfst3_properties(headervalue.data(), remaining_header_len);
         auto type_field = headervalue.find("type");
         if (type_field != std::string::npos) {
             if (headervalue.find("HFST_OL") != type_field + 5 &&
@@ -229,6 +311,8 @@ void TransducerHeader::skip_hfst3_header(char ** raw)
             remaining_header_len = *((unsigned short *) *raw);
         }
         //std::cerr << "remaining_header_len " << remaining_header_len << std::endl;
+        parse_hfst3_properties(*raw + sizeof(uint16_t) + 1,
+                               remaining_header_len);
         (*raw) += sizeof(uint16_t) + 1 + remaining_header_len;
     } else // nope. put back what we've taken
     {
@@ -240,8 +324,29 @@ void TransducerHeader::skip_hfst3_header(char ** raw)
     }
 }
 
+void TransducerHeader::parse_hfst3_properties(const char * data,
+                                              size_t length)
+{
+    // the header is a sequence of NUL-terminated key and value strings
+    size_t pos = 0;
+    while (pos < length) {
+        const char * key = data + pos;
+        size_t key_length = strnlen(key, length - pos);
+        pos += key_length + 1;
+        if (pos >= length) {
+            break;
+        }
+        const char * value = data + pos;
+        size_t value_length = strnlen(value, length - pos);
+        pos += value_length + 1;
+        properties[std::string(key, key_length)] =
+            std::string(value, value_length);
+    }
+}
+
 TransducerHeader::TransducerHeader(FILE* f)
 {
+    LoadPhaseTimer timer("header parsing");
     skip_hfst3_header(f); // skip header iff it is present
     if (is_big_endian()) {
         // no error checking yet
@@ -291,6 +396,7 @@ TransducerHeader::TransducerHeader(FILE* f)
 
 TransducerHeader::TransducerHeader(char** raw)
 {
+    LoadPhaseTimer timer("header parsing");
     skip_hfst3_header(raw); // skip header iff it is present
     if (is_big_endian()) {
         number_of_input_symbols = read_uint16_flipping_endianness(*raw);
@@ -361,6 +467,17 @@ TransducerHeader::target_table_size()
     return size_of_transition_target_table;
 }
 
+std::string
+TransducerHeader::get_property(const std::string & key) const
+{
+    std::map<std::string, std::string>::const_iterator it =
+        properties.find(key);
+    if (it == properties.end()) {
+        return "";
+    }
+    return it->second;
+}
+
 bool
 TransducerHeader::probe_flag(HeaderFlag flag)
 {
@@ -583,7 +700,9 @@ TransducerAlphabet::TransducerAlphabet(FILE* f, SymbolNumber number_of_symbols):
     identity_symbol(NO_SYMBOL),
     orig_symbol_count(number_of_symbols)
 {
+    LoadPhaseTimer timer("alphabet parsing");
     read(f, number_of_symbols);
+    timer.add_bytes(memory_size());
 }
 
 TransducerAlphabet::TransducerAlphabet(char** raw,
@@ -592,7 +711,9 @@ TransducerAlphabet::TransducerAlphabet(char** raw,
     identity_symbol(NO_SYMBOL),
     orig_symbol_count(number_of_symbols)
 {
+    LoadPhaseTimer timer("alphabet parsing");
     read(raw, number_of_symbols);
+    timer.add_bytes(memory_size());
 }
 
 void TransducerAlphabet::add_symbol(std::string & sym)
@@ -659,6 +780,31 @@ TransducerAlphabet::is_flag(SymbolNumber symbol)
     return operations.count(symbol) == 1;
 }
 
+size_t
+TransducerAlphabet::memory_size(void) const
+{
+    size_t bytes = kt.capacity() * sizeof(std::string);
+    for (auto& sym : kt) {
+        bytes += string_heap_size(sym);
+    }
+    for (auto& it : string_to_symbol) {
+        bytes += MAP_NODE_OVERHEAD + sizeof(it) + string_heap_size(it.first);
+    }
+    bytes += operations.size() *
+        (MAP_NODE_OVERHEAD + sizeof(OperationMap::value_type));
+    return bytes;
+}
+
+uint64_t
+TransducerAlphabet::hash(uint64_t hash) const
+{
+    // symbols added for unknown input later on are not part of the automaton
+    for (SymbolNumber i = 0; i < orig_symbol_count && i < kt.size(); ++i) {
+        hash = hash_bytes(kt[i].c_str(), kt[i].size() + 1, hash);
+    }
+    return hash;
+}
+
 void IndexTable::read(FILE * f,
                       TransitionTableIndex number_of_table_entries)
 {
@@ -777,6 +923,20 @@ bool LetterTrie::has_key_starting_with(const char c) const
     return letters[(unsigned char) c] != NULL;
 }
 
+size_t LetterTrie::memory_size(void) const
+{
+    size_t bytes = letters.capacity() * sizeof(LetterTrie*) +
+        symbols.capacity() * sizeof(SymbolNumber);
+    for (auto& i : letters)
+    {
+        if (i != NULL)
+        {
+            bytes += sizeof(LetterTrie) + i->memory_size();
+        }
+    }
+    return bytes;
+}
+
 LetterTrie::~LetterTrie()
 {
     for (auto& i : letters)
@@ -788,7 +948,9 @@ LetterTrie::~LetterTrie()
 Encoder::Encoder(KeyTable * kt, SymbolNumber number_of_input_symbols):
     ascii_symbols(UCHAR_MAX+1,NO_SYMBOL)
 {
+    LoadPhaseTimer timer("letter trie building");
     read_input_symbols(kt, number_of_input_symbols);
+    timer.add_bytes(memory_size());
 }
 
 void Encoder::read_input_symbol(const char * s, const int s_num)
@@ -894,7 +1056,9 @@ IndexTable::IndexTable(FILE* f,
     indices(NULL),
     size(number_of_table_entries)
 {
+    LoadPhaseTimer timer("index table copy");
     read(f, number_of_table_entries);
+    timer.add_bytes(memory_size());
 }
 
 IndexTable::IndexTable(char ** raw,
@@ -902,7 +1066,9 @@ IndexTable::IndexTable(char ** raw,
     indices(NULL),
     size(number_of_table_entries)
 {
+    LoadPhaseTimer timer("index table copy");
     read(raw, number_of_table_entries);
+    timer.add_bytes(memory_size());
 }
 
 IndexTable::~IndexTable()
@@ -953,12 +1119,26 @@ IndexTable::final_weight(TransitionTableIndex i) const
     }
 }
 
+size_t
+IndexTable::memory_size(void) const
+{
+    return size * TransitionIndex::SIZE;
+}
+
+uint64_t
+IndexTable::hash(uint64_t hash) const
+{
+    return hash_bytes(indices, memory_size(), hash);
+}
+
 TransitionTable::TransitionTable(FILE * f,
                                  TransitionTableIndex transition_count):
     transitions(NULL),
     size(transition_count)
 {
+    LoadPhaseTimer timer("transition table copy");
     read(f, transition_count);
+    timer.add_bytes(memory_size());
 }
 
 TransitionTable::TransitionTable(char ** raw,
@@ -966,7 +1146,9 @@ TransitionTable::TransitionTable(char ** raw,
     transitions(NULL),
     size(transition_count)
 {
+    LoadPhaseTimer timer("transition table copy");
     read(raw, transition_count);
+    timer.add_bytes(memory_size());
 }
 
 TransitionTable::~TransitionTable()
@@ -1032,6 +1214,70 @@ TransitionTable::final(TransitionTableIndex i) const
         target(i) == 1;
 }
 
+size_t
+TransitionTable::memory_size(void) const
+{
+    return size * Transition::SIZE;
+}
+
+uint64_t
+TransitionTable::hash(uint64_t hash) const
+{
+    return hash_bytes(transitions, memory_size(), hash);
+}
+
+bool
+TransitionTable::sort_runs(void)
+{
+    LoadPhaseTimer timer("arc run sorting");
+    timer.add_bytes(memory_size());
+    // A run is always read to its end, so the order within it only changes
+    // the order the arcs are visited in
+    struct Entry {
+        Weight weight;
+        char data[Transition::SIZE];
+    };
+    std::vector<Entry> run;
+    bool nonnegative = true;
+    TransitionTableIndex i = 0;
+    while (i < size) {
+        SymbolNumber input = input_symbol(i);
+        TransitionTableIndex end = i + 1;
+        while (end < size && input_symbol(end) == input) {
+            ++end;
+        }
+        if (input != NO_SYMBOL) {
+            bool sorted = true;
+            for (TransitionTableIndex j = i; j < end; ++j) {
+                if (weight(j) < 0.0) {
+                    nonnegative = false;
+                }
+                if (j > i && weight(j) < weight(j - 1)) {
+                    sorted = false;
+                }
+            }
+            if (!sorted) {
+                run.resize(end - i);
+                for (TransitionTableIndex j = i; j < end; ++j) {
+                    run[j - i].weight = weight(j);
+                    memcpy(run[j - i].data, transitions + Transition::SIZE * j,
+                           Transition::SIZE);
+                }
+                std::stable_sort(run.begin(), run.end(),
+                                 [](const Entry & a, const Entry & b) {
+                                     return a.weight < b.weight;
+                                 });
+                for (TransitionTableIndex j = i; j < end; ++j) {
+                    memcpy(transitions + Transition::SIZE * j, run[j - i].data,
+                           Transition::SIZE);
+                }
+            }
+        }
+        i = end;
+    }
+    return nonnegative;
+}
+
 SymbolNumber Encoder::find_key(char ** p)
 {
     if (ascii_symbols[(unsigned char)(**p)] == NO_SYMBOL)
@@ -1043,4 +1289,10 @@ SymbolNumber Encoder::find_key(char ** p)
     return s;
 }
 
+size_t Encoder::memory_size(void) const
+{
+    return letters.memory_size() +
+        ascii_symbols.capacity() * sizeof(SymbolNumber);
+}
+
 } // namespace hfst_ospell
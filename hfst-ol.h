@@ -32,6 +32,7 @@
 #include <iostream>
 #include <cstring>
 #include <set>
+#include <string>
 #include <utility>
 #include "ol-exceptions.h"
 
@@ -63,6 +64,10 @@ const unsigned int MAX_SYMBOL_BYTES = 1000;
 // This is 2^31, hopefully equal to UINT_MAX/2 rounded up.
 // For some profound reason it can't be replaced with (UINT_MAX+1)/2.
 const TransitionTableIndex TARGET_TABLE = 2147483648u;
+//! HFST3 header property of automata followed by least costs to final
+const char * const MIN_COST_PROPERTY = "min-cost-to-final";
+//! HFST3 header property of automata with arcs sorted by weight in each run
+const char * const SORTED_RUNS_PROPERTY = "weight-sorted-runs";
 
 // the flag diacritic operators as given in
 // Beesley & Karttunen, Finite State Morphology (U of C Press 2003)
@@ -77,12 +82,73 @@ enum HeaderFlag {Weighted, Deterministic, Input_deterministic, Minimized,
 bool is_big_endian(void);
 uint16_t read_uint16_flipping_endianness(FILE * f);
 uint16_t read_uint16_flipping_endianness(char * raw);
+uint32_t read_uint32_flipping_endianness(FILE * f);
 uint32_t read_uint32_flipping_endianness(char * raw);
 float read_float_flipping_endianness(FILE * f);
 
 // Utility function for dealing with raw memory
 void skip_c_string(char ** raw);
 
+//! @brief heap bytes held by the characters of @a s, if any.
+size_t string_heap_size(const std::string & s);
+
+//! @brief bytes of a std::map node besides the key and value in it.
+const size_t MAP_NODE_OVERHEAD = 4 * sizeof(void*);
+
+//! @brief starting value for hash_bytes()
+const uint64_t HASH_SEED = 14695981039346656037ULL;
+
+//! @brief continue the 64-bit FNV-1a hash @a hash over @a len bytes of
+//!        @a data.
+uint64_t hash_bytes(const void * data, size_t len, uint64_t hash = HASH_SEED);
+
+//! @brief Time and memory spent in one phase of loading automata.
+struct LoadPhase
+{
+    std::string name; //!< what was being done
+    double seconds; //!< wall clock time spent in the phase
+    size_t bytes; //!< bytes allocated for the data read in the phase
+    unsigned long count; //!< how many times the phase was entered
+};
+
+typedef std::vector<LoadPhase> LoadProfile;
+
+//! @brief Collects the load phases of the current thread.
+
+//! While a profiler exists, the LoadPhaseTimers of the same thread add their
+//! measurements to its LoadProfile, summing up phases with the same name.
+class LoadProfiler
+{
+private:
+    LoadProfile * previous;
+public:
+    //!
+    //! start collecting phases into @a profile
+    LoadProfiler(LoadProfile * profile);
+    ~LoadProfiler();
+    //!
+    //! add a measurement to the profile of the current thread, if any
+    static void add(const char * name, double seconds, size_t bytes);
+    //!
+    //! add all phases of @a from to @a to
+    static void merge(LoadProfile & to, const LoadProfile & from);
+};
+
+//! @brief Measures the time from construction to destruction as a load phase.
+class LoadPhaseTimer
+{
+private:
+    const char * name;
+    size_t bytes;
+    double start;
+public:
+    LoadPhaseTimer(const char * phase_name);
+    ~LoadPhaseTimer();
+    //!
+    //! record @a n bytes allocated in this phase
+    void add_bytes(size_t n) { bytes += n; }
+};
+
 //! Internal class for Transducer processing.
 
 //! Contains low-level processing stuff.
@@ -106,10 +172,12 @@ private:
     bool has_input_epsilon_transitions;
     bool has_input_epsilon_cycles;
     bool has_unweighted_input_epsilon_cycles;
+    std::map<std::string, std::string> properties;
     void read_property(bool &property, FILE * f);
     void read_property(bool &property, char ** raw);
     void skip_hfst3_header(FILE * f);
     void skip_hfst3_header(char ** f);
+    void parse_hfst3_properties(const char * data, size_t length);
 
 public:
     //!
@@ -134,6 +202,9 @@ public:
     //!
     //! check for flag
     bool probe_flag(HeaderFlag flag);
+    //!
+    //! value of HFST3 header property @a key, empty if missing
+    std::string get_property(const std::string & key) const;
 };
 
 //! Internal class for flag diacritic processing.
@@ -222,6 +293,12 @@ public:
     //!
     //! get if given symbol is a flag
     bool is_flag(SymbolNumber symbol);
+    //!
+    //! heap bytes held by the key table and the symbol lookup maps
+    size_t memory_size(void) const;
+    //!
+    //! hash the symbols read from the automaton into @a hash
+    uint64_t hash(uint64_t hash) const;
 };
 
 class LetterTrie;
@@ -248,6 +325,9 @@ public:
     //! find a key for string or add it
     SymbolNumber find_key(char ** p);
     bool has_key_starting_with(const char c) const;
+    //!
+    //! heap bytes held by this trie and the tries below it
+    size_t memory_size(void) const;
     ~LetterTrie();
 };
 
@@ -269,6 +349,9 @@ public:
     SymbolNumber find_key(char ** p);
     void read_input_symbol(const char * s, const int s_num);
     void read_input_symbol(std::string const & s, const int s_num);
+    //!
+    //! heap bytes held by the letter trie and ascii lookup
+    size_t memory_size(void) const;
 };
 
 typedef std::vector<ValueNumber> FlagDiacriticState;
@@ -400,6 +483,12 @@ public:
     //!
     //! transition's weight
     Weight final_weight(TransitionTableIndex i) const;
+    //!
+    //! bytes of the table data
+    size_t memory_size(void) const;
+    //!
+    //! hash the table data into @a hash
+    uint64_t hash(uint64_t hash) const;
 };
 
 //! Internal class for transition processing.
@@ -447,7 +536,16 @@ public:
     //!
     //! whether it's final
     bool final(TransitionTableIndex i) const;
-
+    //!
+    //! bytes of the table data
+    size_t memory_size(void) const;
+    //!
+    //! hash the table data into @a hash
+    uint64_t hash(uint64_t hash) const;
+    //!
+    //! sort the arcs of each run of one input symbol by weight, and tell
+    //! whether no arc weight is negative
+    bool sort_runs(void);
 
 };
 
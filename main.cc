@@ -35,10 +35,20 @@
 #include <cstdarg>
 #include <stdio.h>
 #include <errno.h>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <iterator>
 
 #include "ol-exceptions.h"
 #include "ospell.h"
 #include "ZHfstOspeller.h"
+#include "server.h"
+#include "document.h"
 
 using hfst_ospell::ZHfstOspeller;
 using hfst_ospell::Transducer;
@@ -57,6 +67,20 @@ static std::string lexicon_filename = "";
 #endif
 static bool suggest = false;
 static bool suggest_reals = false;
+static bool profile_load = false;
+static bool warm_cache = false;
+static unsigned int warm_cache_threads = 0;
+static std::string cache_filename = "";
+static size_t cache_budget = 0;
+static std::string trace_filename = "";
+static size_t suffix_memo = 0;
+static unsigned long node_budget = 0;
+static bool ignore_case = false;
+static std::string server_socket = "";
+static unsigned int jobs = 0;
+static bool document = false;
+//! output to stdout is collected here instead when set
+static thread_local std::string* captured_output = 0;
 
 #ifdef WINDOWS
 static std::string wide_string_to_string(const std::wstring & wstr)
@@ -72,6 +96,22 @@ static int hfst_fprintf(FILE * stream, const char * format, ...)
 {
   va_list args;
   va_start(args, format);
+  if (captured_output != 0 && stream == stdout)
+    {
+      va_list measure;
+      va_copy(measure, args);
+      int length = vsnprintf(NULL, 0, format, measure);
+      va_end(measure);
+      if (length > 0)
+        {
+          size_t old_size = captured_output->size();
+          captured_output->resize(old_size + length + 1);
+          vsnprintf(&(*captured_output)[old_size], length + 1, format, args);
+          captured_output->resize(old_size + length);
+        }
+      va_end(args);
+      return length;
+    }
 #ifdef WINDOWS
   if (output_to_console && (stream == stdout || stream == stderr))
     {
@@ -132,10 +172,33 @@ bool print_usage(void)
     "  -w, --max-weight=W        Suppress corrections with weights above W\n" <<
     "  -b, --beam=W              Suppress corrections worse than best candidate by more than W\n" <<
     "  -t, --time-cutoff=T       Stop trying to find better corrections after T seconds (T is a float)\n" <<
+    "      --node-budget=N       Stop trying to find better corrections after N\n"
+    "                            search steps, the same on every run\n" <<
+    "      --ignore-case         Accept words in any case and give corrections\n"
+    "                            the case of the misspelling\n" <<
     "  -S, --suggest             Suggest corrections to mispellings\n" <<
     "  -X, --real-word           Also suggest corrections to correct words\n" <<
     "  -m, --error-model         Use this error model (must also give lexicon as option)\n" <<
     "  -l, --lexicon             Use this lexicon (must also give erro model as option)\n" <<
+    "      --profile-load        Load the speller immediately and print time and\n"
+    "                            memory spent in each phase of loading to stderr\n" <<
+    "      --warm-cache[=N]      Build the correction cache for all symbols at\n"
+    "                            startup using N threads (default: one per core)\n" <<
+    "      --cache-file=FILE     Read the correction cache from FILE, or build it\n"
+    "                            and write it to FILE if it does not match\n" <<
+    "      --cache-budget=BYTES  Keep at most BYTES of cached corrections\n" <<
+    "      --suffix-memo=BYTES   Remember corrections of word endings across\n"
+    "                            words in at most BYTES, under a weight limit\n" <<
+    "      --trace-states=FILE   Count the automaton states visited and write\n"
+    "                            them to FILE for hfst-ospell-optimize\n" <<
+    "      --server=SOCKET       Serve requests of many clients on the Unix\n"
+    "                            domain socket SOCKET instead of standard input\n" <<
+    "      --document            Read standard input as running text and print\n"
+    "                            the byte offset and word of each misspelling,\n"
+    "                            and the suggestions with -S\n" <<
+    "  -j, --jobs=N              Check N lines at a time, printing the results\n"
+    "                            in input order; with --server, N searches at a\n"
+    "                            time (default: one per core)\n" <<
 #ifdef WINDOWS
     "  -k, --output-to-console   Print output to console (Windows-specific)" <<
 #endif
@@ -169,6 +232,10 @@ do_suggest(ZHfstOspeller& speller, const std::string& str)
         hfst_fprintf(stdout, "Suggesting for %s:\n", str.c_str());
       }
     hfst_ospell::CorrectionQueue corrections = speller.suggest(str);
+    if (verbose && speller.suggestions_truncated())
+      {
+        hfst_fprintf(stdout, "Search for %s stopped early\n", str.c_str());
+      }
     if (corrections.size() > 0)
     {
         hfst_fprintf(stdout, "Corrections for \"%s\":\n", str.c_str());
@@ -277,63 +344,286 @@ do_spell(ZHfstOspeller& speller, const std::string& str)
       }
   }
 
+//! @brief Spells lines in a pool of worker threads and prints what
+//!        do_spell() would have printed for each, in input order.
+class SpellPipeline
+  {
+  public:
+    SpellPipeline(ZHfstOspeller& speller, unsigned int jobs) :
+        speller_(speller),
+        read_(0),
+        written_(0),
+        max_pending_(64 * jobs),
+        input_done_(false),
+        workers_done_(false)
+      {
+        speller_.set_concurrency(jobs);
+        for (unsigned int i = 0; i < jobs; ++i)
+          {
+            workers_.push_back(std::thread(&SpellPipeline::work, this));
+          }
+        writer_ = std::thread(&SpellPipeline::write, this);
+      }
+    //! @brief queue @a line, waiting while too many lines are unwritten.
+    void push(const std::string& line)
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        written_cond_.wait(lock, [this]()
+                           { return read_ - written_ < max_pending_; });
+        lines_.push_back(std::make_pair(read_++, line));
+        line_ready_.notify_one();
+      }
+    //! @brief wait until every line queued has been printed.
+    void finish()
+      {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          input_done_ = true;
+        }
+        line_ready_.notify_all();
+        for (auto& worker : workers_)
+          {
+            worker.join();
+          }
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          workers_done_ = true;
+        }
+        output_ready_.notify_all();
+        writer_.join();
+      }
+  private:
+    void work()
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+          {
+            line_ready_.wait(lock, [this]()
+                             { return !lines_.empty() || input_done_; });
+            if (lines_.empty())
+              {
+                return;
+              }
+            std::pair<size_t, std::string> line = lines_.front();
+            lines_.pop_front();
+            lock.unlock();
+            std::string output;
+            captured_output = &output;
+            do_spell(speller_, line.second);
+            captured_output = 0;
+            lock.lock();
+            outputs_[line.first].swap(output);
+            output_ready_.notify_one();
+          }
+      }
+    void write()
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+          {
+            output_ready_.wait(lock, [this]()
+                               { return outputs_.count(written_) > 0 ||
+                                        workers_done_; });
+            auto next = outputs_.find(written_);
+            if (next == outputs_.end())
+              {
+                return;
+              }
+            std::string output;
+            output.swap(next->second);
+            outputs_.erase(next);
+            lock.unlock();
+            hfst_fprintf(stdout, "%s", output.c_str());
+            lock.lock();
+            ++written_;
+            written_cond_.notify_all();
+          }
+      }
+    ZHfstOspeller& speller_;
+    //! @brief lines read and not yet taken by a worker, by number
+    std::deque<std::pair<size_t, std::string> > lines_;
+    //! @brief output of lines spelled and not yet printed, by number
+    std::map<size_t, std::string> outputs_;
+    size_t read_;
+    size_t written_;
+    size_t max_pending_;
+    bool input_done_;
+    bool workers_done_;
+    std::mutex mutex_;
+    std::condition_variable line_ready_;
+    std::condition_variable output_ready_;
+    std::condition_variable written_cond_;
+    std::vector<std::thread> workers_;
+    std::thread writer_;
+  };
+
+void
+print_load_profile(const ZHfstOspeller& speller)
+{
+  double total_seconds = 0.0;
+  size_t total_bytes = 0;
+  hfst_fprintf(stderr, "%-24s %8s %12s %14s\n",
+               "phase", "count", "msecs", "bytes");
+  for (auto& phase : speller.get_load_profile())
+    {
+      hfst_fprintf(stderr, "%-24s %8lu %12.3f %14zu\n",
+                   phase.name.c_str(), phase.count, phase.seconds * 1000.0,
+                   phase.bytes);
+      total_seconds += phase.seconds;
+      total_bytes += phase.bytes;
+    }
+  hfst_fprintf(stderr, "%-24s %8s %12.3f %14zu\n",
+               "total", "", total_seconds * 1000.0, total_bytes);
+}
+
+//! @brief print what the searches of @a speller have done, to see that
+//!        the caches and limits asked for were used.
+void
+print_search_statistics(const ZHfstOspeller& speller)
+{
+  hfst_ospell::SearchStatistics statistics = speller.search_statistics();
+  hfst_fprintf(stdout, "Corrections searched: %lu\n", statistics.corrections);
+  hfst_fprintf(stdout, "Cache entries warmed: %lu\n",
+               statistics.cache_warmed);
+  hfst_fprintf(stdout, "Cache entries loaded: %lu\n",
+               statistics.cache_loaded);
+  hfst_fprintf(stdout, "Cache entries built while correcting: %lu\n",
+               statistics.cache_built);
+  hfst_fprintf(stdout, "Cache hits: %lu\n", statistics.cache_hits);
+  hfst_fprintf(stdout, "Suffix memo hits: %lu\n",
+               statistics.suffix_memo_hits);
+  hfst_fprintf(stdout, "Suffix memo misses: %lu\n",
+               statistics.suffix_memo_misses);
+  hfst_fprintf(stdout, "Searches stopped early: %lu\n",
+               statistics.truncated);
+}
+
+//! @brief check standard input as one document, printing a line of byte
+//!        offset, word and suggestions per misspelling.
 int
-zhfst_spell(char* zhfst_filename)
+spell_document(ZHfstOspeller& speller)
 {
-  ZHfstOspeller speller;
+  std::string text((std::istreambuf_iterator<char>(std::cin)),
+                   std::istreambuf_iterator<char>());
+  std::vector<hfst_ospell::DocumentError> errors;
   try
     {
-      speller.read_zhfst(zhfst_filename);
+      errors = hfst_ospell::spell_document(speller, text, suggest,
+                                           std::max(1u, jobs));
     }
-  catch (hfst_ospell::ZHfstMetaDataParsingError& zhmdpe)
+  catch (hfst_ospell::ZHfstZipReadingError& zhzre)
     {
-      hfst_fprintf(stderr, "cannot finish reading zhfst archive %s:\n%s.\n",
-                         zhfst_filename, zhmdpe.what());
+      hfst_fprintf(stderr, "cannot load speller:\n%s.\n", zhzre.what());
       return EXIT_FAILURE;
     }
-  catch (hfst_ospell::ZHfstZipReadingError& zhzre)
+  for (auto& error : errors)
     {
-      hfst_fprintf(stderr,
-                         "cannot read zhfst archive %s:\n"
-                         "%s.\n",
-                         zhfst_filename, zhzre.what());
-      return EXIT_FAILURE;
+      hfst_fprintf(stdout, "%zu\t%s", error.offset, error.word.c_str());
+      for (auto& suggestion : error.suggestions)
+        {
+          hfst_fprintf(stdout, "\t%s", suggestion.c_str());
+        }
+      hfst_fprintf(stdout, "\n");
     }
-  catch (hfst_ospell::ZHfstXmlParsingError& zhxpe)
+  return EXIT_SUCCESS;
+}
+
+//! @brief fill the correction cache of a newly read @a speller as asked
+//!        on the command line.
+static void
+prepare_cache(ZHfstOspeller& speller)
+{
+  // the cache is built for the input as it is matched, and warmed and
+  // written within its budget
+  speller.set_case_folding(ignore_case);
+  speller.set_cache_budget(cache_budget);
+  if (cache_filename != "")
     {
-      hfst_fprintf(stderr,
-                         "Cannot finish reading index.xml from %s:\n"
-                         "%s.\n",
-                         zhfst_filename, zhxpe.what());
-      return EXIT_FAILURE;
+      if (!speller.read_cache(cache_filename))
+        {
+          speller.warm_cache(warm_cache_threads);
+          if (!speller.write_cache(cache_filename))
+            {
+              hfst_fprintf(stderr, "cannot write cache to %s\n",
+                           cache_filename.c_str());
+            }
+        }
     }
-  if (verbose)
+  else if (warm_cache)
     {
-      hfst_fprintf(stdout,
-                         "Following metadata was read from ZHFST archive:\n"
-                         "%s\n",
-                         speller.metadata_dump().c_str());
+      speller.warm_cache(warm_cache_threads);
     }
+}
+
+//! @brief set the search limits given on the command line for @a speller.
+static void
+set_limits(ZHfstOspeller& speller)
+{
+  speller.set_suffix_memo(suffix_memo);
   speller.set_queue_limit(suggs);
-  if (suggs != 0 && verbose)
+  speller.set_weight_limit(max_weight);
+  speller.set_beam(beam);
+  speller.set_time_cutoff(time_cutoff);
+  speller.set_node_budget(node_budget);
+}
+
+//! @brief tell which of the search limits are in use.
+static void
+print_limits()
+{
+  if (!verbose)
+    {
+      return;
+    }
+  if (suggs != 0)
     {
       hfst_fprintf(stdout, "Printing only %lu top suggestions per line\n", suggs);
     }
-  speller.set_weight_limit(max_weight);
-  if (max_weight >= 0.0 && verbose)
-  {
+  if (max_weight >= 0.0)
+    {
       hfst_fprintf(stdout, "Not printing suggestions worse than %f\n", max_weight);
-  }
-  speller.set_beam(beam);
-  if (beam >= 0.0 && verbose)
-  {
+    }
+  if (beam >= 0.0)
+    {
       hfst_fprintf(stdout, "Not printing suggestions worse than best by margin %f\n", beam);
-  }
-  speller.set_time_cutoff(time_cutoff);
-  if (time_cutoff >= 0.0 && verbose)
-  {
+    }
+  if (time_cutoff >= 0.0)
+    {
       hfst_fprintf(stdout, "Not trying to find better suggestions after %f seconds\n", time_cutoff);
-  }
+    }
+  if (node_budget != 0)
+    {
+      hfst_fprintf(stdout, "Not trying to find better suggestions after %lu steps\n", node_budget);
+    }
+}
+
+//! @brief check standard input line by line, or as one document, with
+//!        @a speller, whose automata were read from @a source.
+static int
+spell_input(ZHfstOspeller& speller, const char* source)
+{
+  if (document)
+    {
+      return spell_document(speller);
+    }
+  std::unique_ptr<SpellPipeline> pipeline;
+  if (jobs > 1)
+    {
+      try
+        {
+          pipeline.reset(new SpellPipeline(speller, jobs));
+          if (verbose)
+            {
+              hfst_fprintf(stdout, "Checking %u lines at a time\n", jobs);
+            }
+        }
+      catch (hfst_ospell::ZHfstZipReadingError& zhzre)
+        {
+          hfst_fprintf(stderr, "cannot load speller from %s:\n%s.\n",
+                       source, zhzre.what());
+          return EXIT_FAILURE;
+        }
+    }
   char * str = (char*) malloc(2000);
 
 
@@ -365,66 +655,126 @@ zhfst_spell(char* zhfst_filename)
             exit(1);
 #endif
           }
-        do_spell(speller, str);
+        if (pipeline)
+          {
+            pipeline->push(str);
+          }
+        else
+          {
+            do_spell(speller, str);
+          }
       }
     free(str);
-    return EXIT_SUCCESS;
-}
-
-int
-    legacy_spell(hfst_ospell::Speller * s)
-{
-      ZHfstOspeller speller;
-      speller.inject_speller(s);
-      speller.set_queue_limit(suggs);
-      if (suggs != 0 && verbose)
+    if (pipeline)
       {
-          hfst_fprintf(stdout, "Printing only %lu top suggestions per line\n", suggs);
+        pipeline->finish();
       }
-      speller.set_weight_limit(max_weight);
-      if (max_weight >= 0.0 && verbose)
+    if (verbose)
       {
-          hfst_fprintf(stdout, "Not printing suggestions worse than %f\n", suggs);
+        print_search_statistics(speller);
       }
-      speller.set_beam(beam);
-      if (beam >= 0.0 && verbose)
+    if (trace_filename != "" && !speller.write_state_trace(trace_filename))
       {
-          hfst_fprintf(stdout, "Not printing suggestions worse than best by margin %f\n", suggs);
+        hfst_fprintf(stderr, "cannot write state trace to %s\n",
+                     trace_filename.c_str());
+        return EXIT_FAILURE;
       }
-      char * str = (char*) malloc(2000);
+    return EXIT_SUCCESS;
+}
 
-#ifdef WINDOWS
-    SetConsoleCP(65001);
-    const HANDLE stdIn = GetStdHandle(STD_INPUT_HANDLE);
-    WCHAR buffer[0x1000];
-    DWORD numRead = 0;
-    while (ReadConsoleW(stdIn, buffer, sizeof buffer, &numRead, NULL))
-      {
-        std::wstring wstr(buffer, numRead-1); // skip the newline
-        std::string linestr = wide_string_to_string(wstr);
-        free(str);
-        str = strdup(linestr.c_str());
-#else
-    while (!std::cin.eof()) {
-        std::cin.getline(str, 2000);
-#endif
-        if (str[0] == '\0') {
-            continue;
+int
+zhfst_spell(char* zhfst_filename)
+{
+  std::shared_ptr<ZHfstOspeller> loaded = std::make_shared<ZHfstOspeller>();
+  ZHfstOspeller& speller = *loaded;
+  try
+    {
+      speller.read_zhfst(zhfst_filename);
+      prepare_cache(speller);
+      // errors in the automata are reported here, not at the first word
+      speller.load_speller();
+    }
+  catch (hfst_ospell::ZHfstMetaDataParsingError& zhmdpe)
+    {
+      hfst_fprintf(stderr, "cannot finish reading zhfst archive %s:\n%s.\n",
+                         zhfst_filename, zhmdpe.what());
+      return EXIT_FAILURE;
+    }
+  catch (hfst_ospell::ZHfstZipReadingError& zhzre)
+    {
+      hfst_fprintf(stderr,
+                         "cannot read zhfst archive %s:\n"
+                         "%s.\n",
+                         zhfst_filename, zhzre.what());
+      return EXIT_FAILURE;
+    }
+  catch (hfst_ospell::ZHfstXmlParsingError& zhxpe)
+    {
+      hfst_fprintf(stderr,
+                         "Cannot finish reading index.xml from %s:\n"
+                         "%s.\n",
+                         zhfst_filename, zhxpe.what());
+      return EXIT_FAILURE;
+    }
+  if (profile_load)
+    {
+      print_load_profile(speller);
+    }
+  if (verbose)
+    {
+      hfst_fprintf(stdout,
+                         "Following metadata was read from ZHFST archive:\n"
+                         "%s\n",
+                         speller.metadata_dump().c_str());
+    }
+  set_limits(speller);
+  print_limits();
+  if (trace_filename != "")
+    {
+      speller.set_state_tracing(true);
+    }
+  if (server_socket != "")
+    {
+      unsigned int searches = (jobs > 0) ? jobs
+          : std::max(1u, std::thread::hardware_concurrency());
+      try
+        {
+          speller.set_concurrency(searches);
+          // archives reloaded on SIGHUP are set up like this one
+          hfst_ospell::ZHfstOspellerHandle spellers(
+              std::move(loaded), zhfst_filename,
+              [searches](ZHfstOspeller& fresh)
+                {
+                  prepare_cache(fresh);
+                  set_limits(fresh);
+                  fresh.set_concurrency(searches);
+                });
+          return hfst_ospell::serve_socket(spellers, server_socket,
+                                            searches);
+        }
+      catch (hfst_ospell::ZHfstZipReadingError& zhzre)
+        {
+          hfst_fprintf(stderr, "cannot load speller from %s:\n%s.\n",
+                       zhfst_filename, zhzre.what());
+          return EXIT_FAILURE;
         }
-        if (str[strlen(str) - 1] == '\r')
-          {
-#ifdef WINDOWS
-            str[strlen(str) - 1] = '\0';
-#else
-            hfst_fprintf(stderr, "There is a WINDOWS linebreak in this file\n"
-                               "Please convert with dos2unix or fromdos\n");
-            exit(1);
-#endif
-          }
-        do_spell(speller, str);
     }
-    free(str);
-    return EXIT_SUCCESS;
+  return spell_input(speller, zhfst_filename);
+}
+
+int
+    legacy_spell(hfst_ospell::Speller * s)
+{
+      ZHfstOspeller speller;
+      speller.inject_speller(s);
+      prepare_cache(speller);
+      set_limits(speller);
+      print_limits();
+      if (trace_filename != "")
+        {
+          speller.set_state_tracing(true);
+        }
+      return spell_input(speller, error_model_filename.c_str());
 }
 
 int main(int argc, char **argv)
@@ -452,6 +802,17 @@ int main(int argc, char **argv)
             {"real-word",    no_argument,       0, 'X'},
             {"error-model",  required_argument, 0, 'm'},
             {"lexicon",      required_argument, 0, 'l'},
+            {"profile-load", no_argument,       0, 'P'},
+            {"warm-cache",   optional_argument, 0, 'W'},
+            {"cache-file",   required_argument, 0, 'C'},
+            {"cache-budget", required_argument, 0, 'B'},
+            {"trace-states", required_argument, 0, 'T'},
+            {"suffix-memo",  required_argument, 0, 'M'},
+            {"node-budget",  required_argument, 0, 'N'},
+            {"ignore-case",  no_argument,       0, 'I'},
+            {"server",       required_argument, 0, 'Z'},
+            {"jobs",         required_argument, 0, 'j'},
+            {"document",     no_argument,       0, 'D'},
 #ifdef WINDOWS
             {"output-to-console",       no_argument,       0, 'k'},
 #endif
@@ -459,7 +820,7 @@ int main(int argc, char **argv)
             };
 
         int option_index = 0;
-        c = getopt_long(argc, argv, "hVvqsan:w:b:t:SXm:l:k", long_options, &option_index);
+        c = getopt_long(argc, argv, "hVvqsan:w:b:t:SXm:l:kj:", long_options, &option_index);
         char* endptr = 0;
 
         if (c == -1) // no more options to look at
@@ -551,12 +912,74 @@ int main(int argc, char **argv)
         case 'X':
             suggest_reals = true;
             break;
+        case 'C':
+            cache_filename = optarg;
+            break;
+        case 'T':
+            trace_filename = optarg;
+            break;
+        case 'Z':
+            server_socket = optarg;
+            break;
+        case 'D':
+            document = true;
+            break;
+        case 'j':
+            jobs = strtoul(optarg, &endptr, 10);
+            if (endptr == optarg)
+              {
+                fprintf(stderr, "%s not a strtoul number\n", optarg);
+                exit(1);
+              }
+            break;
+        case 'M':
+            suffix_memo = strtoul(optarg, &endptr, 10);
+            if (endptr == optarg)
+              {
+                fprintf(stderr, "%s not a strtoul number\n", optarg);
+                exit(1);
+              }
+            break;
+        case 'N':
+            node_budget = strtoul(optarg, &endptr, 10);
+            if (endptr == optarg)
+              {
+                fprintf(stderr, "%s not a strtoul number\n", optarg);
+                exit(1);
+              }
+            break;
+        case 'I':
+            ignore_case = true;
+            break;
+        case 'B':
+            cache_budget = strtoul(optarg, &endptr, 10);
+            if (endptr == optarg)
+              {
+                fprintf(stderr, "%s not a strtoul number\n", optarg);
+                exit(1);
+              }
+            break;
         case 'm':
             error_model_filename = optarg;
             break;
         case 'l':
             lexicon_filename = optarg;
             break;
+        case 'P':
+            profile_load = true;
+            break;
+        case 'W':
+            warm_cache = true;
+            if (optarg != NULL)
+              {
+                warm_cache_threads = strtoul(optarg, &endptr, 10);
+                if (endptr == optarg)
+                  {
+                    fprintf(stderr, "%s not a strtoul number\n", optarg);
+                    exit(1);
+                  }
+              }
+            break;
         default:
             std::cerr << "Invalid option\n\n";
             print_short_help();
@@ -592,6 +1015,12 @@ int main(int argc, char **argv)
               print_short_help();
               return EXIT_FAILURE;
           }
+          if (server_socket != "") {
+              // the server reloads its speller from a zhfst archive
+              std::cerr << "--server needs a zhfst speller, not --error-model and --lexicon"
+                        << std::endl;
+              return EXIT_FAILURE;
+          }
           FILE * err_file = fopen(error_model_filename.c_str(), "r");
           FILE * lex_file = fopen(lexicon_filename.c_str(), "r");
           hfst_ospell::Transducer err(err_file);
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+# Copyright 2010 University of Helsinki
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+"""Write case-table.h, the case pairs ospell.cc folds letters with, from
+the simple case mappings of the Unicode Character Database:
+
+    ./make-case-table.py UnicodeData.txt > case-table.h
+
+A capital and a small letter make a pair when each is the simple mapping
+of the other, so title case letters and the mappings that only go one way
+(dotted capital I, long s, final sigma) are left out. The pairs are
+written as runs of capitals whose small letters are the same number of
+code points away, either consecutive or every other code point."""
+
+import sys
+
+
+def read_pairs(path):
+    upper = {}
+    lower = {}
+    with open(path, encoding='utf-8') as data:
+        for line in data:
+            fields = line.rstrip('\n').split(';')
+            code = int(fields[0], 16)
+            if fields[12]:
+                upper[code] = int(fields[12], 16)
+            if fields[13]:
+                lower[code] = int(fields[13], 16)
+    return sorted((capital, small) for capital, small in lower.items()
+                  if small != capital and upper.get(small) == capital)
+
+
+def make_runs(pairs):
+    runs = []
+    i = 0
+    while i < len(pairs):
+        first, small = pairs[i]
+        delta = small - first
+        best = (1, False)
+        for step, alternating in ((1, False), (2, True)):
+            length = 1
+            while (i + length < len(pairs) and
+                   pairs[i + length][0] == first + step * length and
+                   pairs[i + length][1] - pairs[i + length][0] == delta):
+                length += 1
+            if length > best[0]:
+                best = (length, alternating)
+        length, alternating = best
+        last = pairs[i + length - 1][0]
+        runs.append((first, last, delta, alternating))
+        i += length
+    return runs
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    runs = make_runs(read_pairs(sys.argv[1]))
+    print('''/* -*- Mode: C++ -*- */
+// Generated by make-case-table.py from UnicodeData.txt; do not edit.
+
+#ifndef HFST_OSPELL_CASE_TABLE_H_
+#define HFST_OSPELL_CASE_TABLE_H_ 1
+
+//! a run of capital letters whose small letters are @a delta code points
+//! later, every other code point from @a first if @a alternating
+struct CaseRange
+{
+    unsigned int first;
+    unsigned int last;
+    int delta;
+    bool alternating;
+};
+
+//! the one-to-one simple case pairs of Unicode, sorted by capital letter
+static const CaseRange CASE_RANGES[] = {''')
+    entries = ['{0x%X, 0x%X, %d, %s}' % (first, last, delta,
+                                          'true' if alternating else 'false')
+               for first, last, delta, alternating in runs]
+    line = '   '
+    for entry in entries:
+        if len(line) + len(entry) + 2 > 78:
+            print(line.rstrip())
+            line = '   '
+        line += ' ' + entry + ','
+    print(line.rstrip(','))
+    print('};')
+    print()
+    print('#endif // HFST_OSPELL_CASE_TABLE_H_')
+
+
+if __name__ == '__main__':
+    main()
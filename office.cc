@@ -42,7 +42,17 @@
 #include <cmath>
 #include <cerrno>
 #include <cctype>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <getopt.h>
+#ifndef WINDOWS
+#include <signal.h>
+#include <pthread.h>
+#endif
 
 #define U_CHARSET_IS_UTF8 1
 #include <unicode/uclean.h>
@@ -55,60 +65,92 @@ using namespace icu;
 #include "ZHfstOspeller.h"
 
 using hfst_ospell::ZHfstOspeller;
+using hfst_ospell::ZHfstOspellerSet;
 using hfst_ospell::Transducer;
 
 typedef std::map<UnicodeString,bool> valid_words_t;
-valid_words_t valid_words;
 
 struct word_t {
 	size_t start, count;
 	UnicodeString buffer;
 };
-std::vector<word_t> words(16);
-std::string buffer, wbuf;
 using Alt = std::pair<double,std::string>;
-std::vector<Alt> alts;
-std::unordered_set<std::string> outputs;
-UnicodeString ubuffer, uc_buffer;
-size_t cw;
+
+// Everything one token is checked with, so that several threads can each check their own
+struct checker_t {
+	valid_words_t valid_words;
+	std::vector<word_t> words = std::vector<word_t>(16);
+	std::string buffer, wbuf;
+	std::vector<Alt> alts;
+	std::unordered_set<std::string> outputs;
+	UnicodeString ubuffer, uc_buffer;
+	size_t cw = 0;
+	std::vector<std::string> forms;
+	std::vector<hfst_ospell::Weight> offsets;
+	bool uc_first = false;
+	bool uc_all = true;
+	// The speller valid_words was filled by, not kept alive by it
+	std::weak_ptr<ZHfstOspeller> speller;
+};
+
+// Added to the weight of corrections for each step of trimming or case folding
+const hfst_ospell::Weight variant_offset = 1.0;
 
 bool verbatim = false;
 bool debug = false;
 hfst_ospell::Weight max_weight = -1.0;
 hfst_ospell::Weight beam = -1.0;
 float time_cutoff = 6.0;
-bool uc_first = false;
-bool uc_all = true;
-
-bool find_alternatives(ZHfstOspeller& speller, size_t suggs) {
+bool warm_cache = false;
+unsigned int warm_cache_threads = 0;
+size_t cache_budget = 0;
+size_t memory_limit = 0;
+bool pipeline = false;
+unsigned int pipeline_threads = 0;
+
+bool find_alternatives(checker_t& ch, ZHfstOspeller& speller, size_t suggs, std::string& answer) {
+	auto& words = ch.words;
+	auto& buffer = ch.buffer;
+	auto& wbuf = ch.wbuf;
+	auto& alts = ch.alts;
+	auto& outputs = ch.outputs;
+	auto& ubuffer = ch.ubuffer;
+	auto& uc_buffer = ch.uc_buffer;
+	auto& cw = ch.cw;
+	auto& forms = ch.forms;
+	auto& offsets = ch.offsets;
 	outputs.clear();
 	alts.clear();
 
-	// Gather corrections from all the tried variants, starting with verbatim and increasing mangling from there
-	for (size_t k=0 ; k < cw && alts.size()<suggs ; ++k) {
-		buffer.clear();
-		words[k].buffer.toUTF8String(buffer);
-		auto corrections = speller.suggest(buffer);
+	// Search all the tried variants at once, each step of mangling after verbatim weighing a little more
+	forms.resize(cw);
+	offsets.resize(cw);
+	for (size_t k=0 ; k < cw ; ++k) {
+		forms[k].clear();
+		words[k].buffer.toUTF8String(forms[k]);
+		offsets[k] = k * variant_offset;
+	}
+	auto found = speller.suggest(forms, offsets);
 
-		if (corrections.size() == 0) {
-			continue;
-		}
+	for (size_t k=0 ; k < cw ; ++k) {
+		auto& corrections = found[k];
 
 		for (size_t i=0, e=corrections.size() ; i<e ; ++i) {
 			// Work around https://github.com/hfst/hfst-ospell/issues/54
-			if (max_weight > 0.0 && corrections.top().second > max_weight) {
+			// The limit is for the weight before the offset of the variant
+			if (max_weight > 0.0 && corrections.top().second - offsets[k] > max_weight) {
 				break;
 			}
-			auto w = corrections.top().second * (1.0 + k/10.0);
+			auto w = corrections.top().second;
 
 			buffer.clear();
 			if (k != 0) {
 				words[0].buffer.tempSubString(0, words[k].start).toUTF8String(buffer);
 			}
-			if (uc_all) {
+			if (ch.uc_all) {
 				UnicodeString::fromUTF8(corrections.top().first).toUpper().toUTF8String(buffer);
 			}
-			else if (uc_first) {
+			else if (ch.uc_first) {
 				uc_buffer.setTo(UnicodeString::fromUTF8(corrections.top().first));
 				ubuffer.setTo(uc_buffer, 0, 1);
 				ubuffer.toUpper();
@@ -141,18 +183,25 @@ bool find_alternatives(ZHfstOspeller& speller, size_t suggs) {
 	}
 
 	if (!alts.empty()) {
-		std::cout << "&";
+		answer = "&";
 		for (auto& alt : alts) {
-			std::cout << "\t" << alt.second;
+			answer += "\t";
+			answer += alt.second;
 		}
-		std::cout << std::endl;
 		return true;
 	}
 
 	return false;
 }
 
-bool is_valid_word(ZHfstOspeller& speller, const std::string& word, size_t suggs) {
+bool is_valid_word(checker_t& ch, ZHfstOspeller& speller, const std::string& word, size_t suggs) {
+	auto& valid_words = ch.valid_words;
+	auto& words = ch.words;
+	auto& buffer = ch.buffer;
+	auto& ubuffer = ch.ubuffer;
+	auto& cw = ch.cw;
+	auto& uc_first = ch.uc_first;
+	auto& uc_all = ch.uc_all;
 	ubuffer.setTo(UnicodeString::fromUTF8(word));
 
 	if (word.size() == 13 && word[5] == 'D' && word == "nuvviDspeller") {
@@ -280,35 +329,240 @@ bool is_valid_word(ZHfstOspeller& speller, const std::string& word, size_t suggs
 	return false;
 }
 
-int zhfst_spell(const char* zhfst_filename) {
-	ZHfstOspeller speller;
-	try {
-		if (debug) {
-			std::cout << "@@ Loading " << zhfst_filename << " with args max-weight=" << max_weight << ", beam=" << beam << ", time-cutoff=" << time_cutoff << std::endl;
+// Answers a "N token" request with "*", "#", "!" or "&" and the suggestions
+std::string check_token(checker_t& ch, const std::shared_ptr<ZHfstOspeller>& speller, const std::string& request) {
+	if (!speller) {
+		return "!";
+	}
+	// Forget what another speller said, or one freed since
+	if (speller != ch.speller.lock()) {
+		ch.speller = speller;
+		ch.valid_words.clear();
+	}
+
+	// Just in case anyone decides to use the speller for a minor eternity
+	if (ch.valid_words.size() > 20480) {
+		ch.valid_words.clear();
+	}
+
+	std::istringstream ss(request);
+	std::string token;
+	size_t suggs = 0;
+	char c = 0;
+	if (!(ss >> suggs) || !ss.get(c) || !std::getline(ss, token)) {
+		return "!";
+	}
+
+	if (is_valid_word(ch, *speller, token, suggs)) {
+		return "*";
+	}
+
+	std::string answer;
+	if (!suggs || !find_alternatives(ch, *speller, suggs, answer)) {
+		return "#";
+	}
+	return answer;
+}
+
+// Requests of the pipelined protocol being answered by a pool of threads, each answer written as soon as it is found
+struct pipeline_t {
+	struct job_t {
+		std::string id;
+		std::string request;
+		std::shared_ptr<ZHfstOspeller> speller;
+	};
+
+	// Reading more input waits while this many requests are waiting
+	static const size_t max_queued = 1024;
+	// Answers are flushed at the latest after this many
+	static const size_t max_unflushed = 64;
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<job_t> jobs;
+	// Requests waiting or being answered
+	size_t outstanding = 0;
+	bool done = false;
+	std::vector<std::thread> threads;
+	// Held while writing answers
+	std::mutex output;
+	size_t unflushed = 0;
+
+	pipeline_t(unsigned int count) {
+		for (unsigned int i=0 ; i < count ; ++i) {
+			threads.push_back(std::thread(&pipeline_t::run, this));
 		}
-		speller.read_zhfst(zhfst_filename);
-		speller.set_weight_limit(max_weight);
-		speller.set_beam(beam);
-		speller.set_time_cutoff(time_cutoff);
 	}
-	catch (hfst_ospell::ZHfstMetaDataParsingError zhmdpe) {
-		fprintf(stderr, "cannot finish reading zhfst archive %s:\n%s.\n", zhfst_filename, zhmdpe.what());
-		return EXIT_FAILURE;
+
+	~pipeline_t() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+		}
+		changed.notify_all();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		std::cout << std::flush;
 	}
-	catch (hfst_ospell::ZHfstZipReadingError zhzre) {
-		fprintf(stderr, "cannot read zhfst archive %s:\n%s.\n", zhfst_filename, zhzre.what());
-		return EXIT_FAILURE;
+
+	void submit(job_t job) {
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return jobs.size() < max_queued; });
+		jobs.push_back(std::move(job));
+		++outstanding;
+		changed.notify_all();
 	}
-	catch (hfst_ospell::ZHfstXmlParsingError zhxpe) {
-		fprintf(stderr, "Cannot finish reading index.xml from %s:\n%s.\n", zhfst_filename, zhxpe.what());
-		return EXIT_FAILURE;
+
+	// Waits until every request submitted so far has been answered and flushed
+	void drain() {
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return outstanding == 0; });
 	}
 
+	void run() {
+		checker_t ch;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			changed.wait(lock, [this] { return done || !jobs.empty(); });
+			if (jobs.empty()) {
+				return;
+			}
+			job_t job = std::move(jobs.front());
+			jobs.pop_front();
+			changed.notify_all();
+			lock.unlock();
+
+			std::string answer = job.id + "\t" + check_token(ch, job.speller, job.request) + "\n";
+			// An unloaded or reloaded speller is freed here rather than with the lock held
+			job.speller.reset();
+			{
+				std::lock_guard<std::mutex> out(output);
+				std::cout << answer;
+				lock.lock();
+				// With no more requests waiting, the client may be waiting for this answer
+				bool idle = jobs.empty();
+				--outstanding;
+				lock.unlock();
+				if (idle || ++unflushed >= max_unflushed) {
+					std::cout << std::flush;
+					unflushed = 0;
+				}
+			}
+			lock.lock();
+			if (outstanding == 0) {
+				changed.notify_all();
+			}
+		}
+	}
+};
+
+void set_limits(ZHfstOspeller& speller) {
+	speller.set_weight_limit(max_weight);
+	speller.set_beam(beam);
+	speller.set_time_cutoff(time_cutoff);
+}
+
+void prepare_cache(ZHfstOspeller& speller) {
+	speller.set_cache_budget(cache_budget);
+	if (warm_cache) {
+		speller.warm_cache(warm_cache_threads);
+	}
+	if (pipeline) {
+		speller.set_concurrency(pipeline_threads);
+	}
+}
+
+#ifndef WINDOWS
+// Reloads the loaded archives on each SIGHUP, which the threads started after it block, until it is destroyed
+struct reloader_t {
+	ZHfstOspellerSet& languages;
+	sigset_t hangup;
+	std::atomic<bool> stopping{false};
+	std::thread thread;
+
+	reloader_t(ZHfstOspellerSet& languages)
+	  : languages(languages)
+	{
+		sigemptyset(&hangup);
+		sigaddset(&hangup, SIGHUP);
+		pthread_sigmask(SIG_BLOCK, &hangup, 0);
+		thread = std::thread(&reloader_t::run, this);
+	}
+
+	// The archives must outlive the thread, so it is woken up and waited for
+	~reloader_t() {
+		stopping = true;
+		pthread_kill(thread.native_handle(), SIGHUP);
+		thread.join();
+	}
+
+	void run() {
+		while (true) {
+			int signal_number = 0;
+			if (sigwait(&hangup, &signal_number) != 0) {
+				continue;
+			}
+			if (stopping) {
+				return;
+			}
+			try {
+				languages.reload();
+				std::cerr << "@@ Speller reloaded" << std::endl;
+			}
+			catch (std::exception& e) {
+				std::cerr << "@@ Cannot reload speller: " << e.what() << std::endl;
+			}
+		}
+	}
+};
+#endif
+
+int zhfst_spell(const std::vector<const char*>& zhfst_filenames) {
+	// The limits are set by the loop below, as they can change while a new speller is loading
+	ZHfstOspellerSet languages(memory_limit, prepare_cache);
+	std::string locale;
+	for (size_t i=0 ; i < zhfst_filenames.size() ; ++i) {
+		const char* zhfst_filename = zhfst_filenames[i];
+		try {
+			if (debug) {
+				std::cout << "@@ Loading " << zhfst_filename << " with args max-weight=" << max_weight << ", beam=" << beam << ", time-cutoff=" << time_cutoff << std::endl;
+			}
+			auto added = languages.add(zhfst_filename);
+			// The first archive is used until $$l picks another, so load it now
+			if (i == 0) {
+				locale = added;
+				languages.get(locale);
+			}
+		}
+		catch (hfst_ospell::ZHfstMetaDataParsingError zhmdpe) {
+			fprintf(stderr, "cannot finish reading zhfst archive %s:\n%s.\n", zhfst_filename, zhmdpe.what());
+			return EXIT_FAILURE;
+		}
+		catch (hfst_ospell::ZHfstZipReadingError zhzre) {
+			fprintf(stderr, "cannot read zhfst archive %s:\n%s.\n", zhfst_filename, zhzre.what());
+			return EXIT_FAILURE;
+		}
+		catch (hfst_ospell::ZHfstXmlParsingError zhxpe) {
+			fprintf(stderr, "Cannot finish reading index.xml from %s:\n%s.\n", zhfst_filename, zhxpe.what());
+			return EXIT_FAILURE;
+		}
+	}
+
+#ifndef WINDOWS
+	reloader_t reloader(languages);
+#endif
+
 	std::cout << "@@ hfst-ospell-office is alive" << std::endl;
 
 	std::string line;
-	std::string word;
-	std::istringstream ss;
+	// The speller the limits were last set on, which may have been unloaded since
+	std::weak_ptr<ZHfstOspeller> loaded;
+	checker_t checker;
+	std::unique_ptr<pipeline_t> requests;
+	if (pipeline) {
+		requests.reset(new pipeline_t(pipeline_threads));
+	}
 	while (std::getline(std::cin, line)) {
 		while (!line.empty() && std::isspace(line[line.size()-1])) {
 			line.resize(line.size()-1);
@@ -317,6 +571,55 @@ int zhfst_spell(const char* zhfst_filename) {
 			continue;
 		}
 
+		// Options apply to the requests after them, so those before must be answered first
+		bool option = (line.size() > 2 && line[0] == '$' && line[1] == '$');
+		if (requests && option) {
+			requests->drain();
+		}
+
+		if (line.size() > 4 && line[0] == '$' && line[1] == '$' && line[2] == 'l' && line[3] == ' ') {
+			auto wanted = line.substr(4);
+			if (languages.has_locale(wanted)) {
+				locale = wanted;
+				std::cout << "@@ Option locale changed to " << locale << std::endl;
+			}
+			else {
+				std::cout << "@@ No speller for locale " << wanted << std::endl;
+			}
+			continue;
+		}
+
+		std::string id;
+		if (requests && !option) {
+			auto space = line.find(' ');
+			id = line.substr(0, space);
+			line.erase(0, (space == std::string::npos) ? line.size() : space + 1);
+		}
+
+		// Switch to another language or a reloaded speller between lines
+		std::shared_ptr<ZHfstOspeller> current;
+		try {
+			current = languages.get(locale);
+		}
+		catch (std::exception& e) {
+			std::cerr << "@@ Cannot load speller for " << locale << ": " << e.what() << std::endl;
+			if (requests) {
+				requests->submit({id, line, nullptr});
+			}
+			else {
+				std::cout << "!" << std::endl;
+			}
+			continue;
+		}
+		if (current != loaded.lock()) {
+			if (requests) {
+				requests->drain();
+			}
+			loaded = current;
+			set_limits(*current);
+		}
+		ZHfstOspeller& speller = *current;
+
 		if (line.size() >= 5 && line[0] == '$' && line[1] == '$' && line[3] == ' ') {
 			if (line[2] == 'd' && isdigit(line[4]) && line.size() == 5) {
 				debug = (line[4] != '0');
@@ -348,27 +651,11 @@ int zhfst_spell(const char* zhfst_filename) {
 			}
 		}
 
-		// Just in case anyone decides to use the speller for a minor eternity
-		if (valid_words.size() > 20480) {
-			valid_words.clear();
+		if (requests && !option) {
+			requests->submit({id, line, std::move(current)});
 		}
-
-		ss.clear();
-		ss.str(line);
-		size_t suggs = 0;
-		char c = 0;
-		if (!(ss >> suggs) || !ss.get(c) || !std::getline(ss, line)) {
-			std::cout << "!" << std::endl;
-			continue;
-		}
-
-		if (is_valid_word(speller, line, suggs)) {
-			std::cout << "*" << std::endl;
-			continue;
-		}
-
-		if (!suggs || !find_alternatives(speller, suggs)) {
-			std::cout << "#" << std::endl;
+		else {
+			std::cout << check_token(checker, current, line) << std::endl;
 		}
 	}
     return EXIT_SUCCESS;
@@ -376,7 +663,7 @@ int zhfst_spell(const char* zhfst_filename) {
 
 void print_help() {
 	std::cout
-		<< "Usage: hfst-ospell [options] zhfst-archive\n"
+		<< "Usage: hfst-ospell [options] zhfst-archive...\n"
 		<< "\n"
 		<< " -h, --help            Shows this help\n"
 		<< " -d, --debug           Debug output with weights attached to results\n"
@@ -384,6 +671,13 @@ void print_help() {
 		<< " -w, --max-weight=W    Suppress corrections with weights above W\n"
 		<< " -b, --beam=W          Suppress corrections worse than best candidate by more than W\n"
 		<< " -t, --time-cutoff=T   Stop trying to find better corrections after T seconds; defaults to 6.0\n"
+		<< " -W, --warm-cache[=N]  Build the correction cache with N threads before reporting alive\n"
+		<< "     --cache-budget=B  Keep at most B bytes of cached corrections\n"
+		<< "     --memory-limit=B  Unload the least recently used languages when all take more than B bytes\n"
+		<< " -p, --pipeline[=N]    Answer requests prefixed with an ID in N threads, as soon as each is ready\n"
+		<< "\n"
+		<< "With several archives, \"$$l LOCALE\" switches to the archive of that locale.\n"
+		<< "With --pipeline, requests are \"ID N token\" and answers \"ID<tab>answer\", in any order.\n"
 		<< std::flush;
 }
 
@@ -406,13 +700,17 @@ int main(int argc, char **argv) {
 		{"max-weight",   required_argument, 0, 'w'},
 		{"beam",         required_argument, 0, 'b'},
 		{"time-cutoff",  required_argument, 0, 't'},
+		{"warm-cache",   optional_argument, 0, 'W'},
+		{"cache-budget", required_argument, 0, 'B'},
+		{"memory-limit", required_argument, 0, 'M'},
+		{"pipeline",     optional_argument, 0, 'p'},
 		{0,              0,                 0,  0 }
 		};
 
 	int c = 0;
 	while (true) {
 		int option_index = 0;
-		c = getopt_long(argc, argv, "hdTw:b:t:", long_options, &option_index);
+		c = getopt_long(argc, argv, "hdTw:b:t:W::p::", long_options, &option_index);
 
 		if (c == -1) {
 			break;
@@ -442,16 +740,42 @@ int main(int argc, char **argv) {
 		case 't':
 			time_cutoff = std::stof(optarg);
 			break;
+
+		case 'W':
+			warm_cache = true;
+			if (optarg) {
+				warm_cache_threads = std::stoul(optarg);
+			}
+			break;
+
+		case 'B':
+			cache_budget = std::stoul(optarg);
+			break;
+
+		case 'M':
+			memory_limit = std::stoul(optarg);
+			break;
+
+		case 'p':
+			pipeline = true;
+			if (optarg) {
+				pipeline_threads = std::stoul(optarg);
+			}
+			break;
 		}
 	}
 
+	if (pipeline && pipeline_threads == 0) {
+		pipeline_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
 	if (optind >= argc) {
 		throw std::invalid_argument("Must pass a zhfst as argument");
 	}
 
 	std::cerr << std::fixed << std::setprecision(2);
 	std::cout << std::fixed << std::setprecision(2);
-	int rv = zhfst_spell(argv[optind]);
+	int rv = zhfst_spell(std::vector<const char*>(argv + optind, argv + argc));
 
 	u_cleanup();
 	return rv;
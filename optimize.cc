@@ -0,0 +1,944 @@
+/*
+
+  Copyright 2010 University of Helsinki
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+*/
+
+/*
+  This is an offline tool that rewrites the automata of a speller into a
+  layout that is faster to search. The states are renumbered in breadth
+  first order so that the states of one search neighbourhood are close to
+  each other in the tables, or busiest first when given the states visited
+  over a corpus by hfst-ospell --trace-states, the arcs of each input symbol are sorted by
+  weight, and the least weight from each state to a final state is stored
+  after the tables so the speller can drop hopeless search nodes early.
+  Archives are written without compression so the automata can be read
+  without inflating them, and without the correction caches and completion
+  indexes of the old automata.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#else
+#define PACKAGE_NAME
+#define PACKAGE_BUGREPORT
+#define PACKAGE_STRING
+#endif
+#if HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if HAVE_LIBARCHIVE
+#include <archive.h>
+#include <archive_entry.h>
+#endif
+
+#include "ol-exceptions.h"
+#include "ospell.h"
+
+using hfst_ospell::NO_SYMBOL;
+using hfst_ospell::NO_TABLE_INDEX;
+using hfst_ospell::SymbolNumber;
+using hfst_ospell::TARGET_TABLE;
+using hfst_ospell::Transducer;
+using hfst_ospell::TransitionTableIndex;
+using hfst_ospell::Weight;
+
+static bool verbose = false;
+static hfst_ospell::StateTrace trace;
+
+namespace
+{
+
+struct Arc
+{
+    SymbolNumber input;
+    SymbolNumber output;
+    TransitionTableIndex target; //!< state number after reading
+    Weight weight;
+};
+
+//! One state with its arcs in runs of one input class each, the epsilons
+//! and flags in the first run if there are any.
+struct State
+{
+    TransitionTableIndex address; //!< location in the original tables
+    bool final;
+    Weight final_weight;
+    std::vector<std::vector<Arc> > runs;
+    bool indexed; //!< whether it goes in the index table
+    TransitionTableIndex new_address;
+};
+
+typedef std::vector<std::pair<std::string, std::string> > Properties;
+
+//! The parts of a transducer file that are copied as they are.
+struct TransducerParts
+{
+    Properties properties;
+    SymbolNumber input_symbols;
+    SymbolNumber symbols;
+    std::string header_flags;
+    std::string alphabet;
+};
+
+const size_t HEADER_SIZE = 2 * sizeof(SymbolNumber)
+                           + 4 * sizeof(TransitionTableIndex);
+const size_t HEADER_FLAGS_SIZE = 9 * sizeof(uint32_t);
+
+uint16_t
+get_uint16(const std::string &data, size_t pos)
+{
+    return static_cast<uint16_t>(
+        static_cast<unsigned char>(data[pos])
+        | (static_cast<unsigned char>(data[pos + 1]) << 8));
+}
+
+// The files are little endian whatever the host is
+void
+put_uint16(std::string &out, uint16_t value)
+{
+    out += static_cast<char>(value & 0xff);
+    out += static_cast<char>(value >> 8);
+}
+
+void
+put_uint32(std::string &out, uint32_t value)
+{
+    put_uint16(out, static_cast<uint16_t>(value & 0xffff));
+    put_uint16(out, static_cast<uint16_t>(value >> 16));
+}
+
+void
+put_weight(std::string &out, Weight value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_uint32(out, bits);
+}
+
+void
+put_transition(std::string &out, SymbolNumber input, SymbolNumber output,
+               TransitionTableIndex target, Weight weight)
+{
+    put_uint16(out, input);
+    put_uint16(out, output);
+    put_uint32(out, target);
+    put_weight(out, weight);
+}
+
+TransducerParts
+split_transducer(const std::string &data)
+{
+    TransducerParts parts;
+    size_t pos = 0;
+    if (data.size() > 8 && data.compare(0, 5, std::string("HFST\0", 5)) == 0)
+    {
+        size_t length = get_uint16(data, 5);
+        pos = 8;
+        size_t end = pos + length;
+        if (end > data.size())
+        {
+            HFSTOSPELL_THROW_MESSAGE(hfst_ospell::HeaderParsingException,
+                                     "Found broken HFST3 header");
+        }
+        while (pos < end)
+        {
+            std::string key(data.c_str() + pos);
+            pos += key.size() + 1;
+            if (pos >= end)
+            {
+                break;
+            }
+            std::string value(data.c_str() + pos);
+            pos += value.size() + 1;
+            parts.properties.push_back(std::make_pair(key, value));
+        }
+        pos = end;
+    }
+    else
+    {
+        parts.properties.push_back(std::make_pair("version", "3.3"));
+        parts.properties.push_back(std::make_pair("type", "HFST_OLW"));
+    }
+    if (pos + HEADER_SIZE + HEADER_FLAGS_SIZE > data.size())
+    {
+        HFSTOSPELL_THROW_MESSAGE(hfst_ospell::HeaderParsingException,
+                                 "Header ended unexpectedly");
+    }
+    parts.input_symbols = get_uint16(data, pos);
+    parts.symbols = get_uint16(data, pos + 2);
+    pos += HEADER_SIZE;
+    parts.header_flags = data.substr(pos, HEADER_FLAGS_SIZE);
+    pos += HEADER_FLAGS_SIZE;
+    size_t alphabet_start = pos;
+    for (SymbolNumber i = 0; i < parts.symbols; ++i)
+    {
+        pos = data.find('\0', pos);
+        if (pos == std::string::npos)
+        {
+            HFSTOSPELL_THROW_MESSAGE(hfst_ospell::AlphabetParsingException,
+                                     "Alphabet ended unexpectedly");
+        }
+        ++pos;
+    }
+    parts.alphabet = data.substr(alphabet_start, pos - alphabet_start);
+    return parts;
+}
+
+// Read the run of arcs at @a pos the way the speller reads it: either the
+// epsilons and flags, or the arcs of one input symbol.
+std::vector<Arc>
+read_run(Transducer &t, TransitionTableIndex pos, bool epsilons,
+         SymbolNumber symbol)
+{
+    std::vector<Arc> run;
+    for (;; ++pos)
+    {
+        SymbolNumber input = t.transitions.input_symbol(pos);
+        if (input == NO_SYMBOL)
+        {
+            break;
+        }
+        if (epsilons ? (input != 0 && !t.is_flag(input)) : input != symbol)
+        {
+            break;
+        }
+        Arc arc = { input, t.transitions.output_symbol(pos),
+                    t.transitions.target(pos), t.transitions.weight(pos) };
+        run.push_back(arc);
+    }
+    return run;
+}
+
+bool
+is_empty_run(const std::vector<Arc> &run)
+{
+    return run.empty();
+}
+
+bool
+lighter(const Arc &a, const Arc &b)
+{
+    return a.weight < b.weight;
+}
+
+// Epsilons must stay in front of the flags, the error model only reads
+// the epsilons from the start of the run
+bool
+epsilons_lighter(const Arc &a, const Arc &b)
+{
+    if ((a.input == 0) != (b.input == 0))
+    {
+        return a.input == 0;
+    }
+    return a.weight < b.weight;
+}
+
+// Collect the states reachable from the start state in breadth first order
+// and point the arcs at their state numbers.
+std::vector<State>
+read_states(Transducer &t, SymbolNumber input_symbols)
+{
+    std::vector<State> states;
+    std::map<TransitionTableIndex, size_t> numbers;
+    std::queue<size_t> pending;
+    State start = { 0, false, 0.0, std::vector<std::vector<Arc> >(), false,
+                    0 };
+    states.push_back(start);
+    numbers[0] = 0;
+    pending.push(0);
+    while (!pending.empty())
+    {
+        size_t number = pending.front();
+        pending.pop();
+        TransitionTableIndex address = states[number].address;
+        std::vector<std::vector<Arc> > runs;
+        if (address >= TARGET_TABLE)
+        {
+            TransitionTableIndex first = address - TARGET_TABLE + 1;
+            SymbolNumber input = t.transitions.input_symbol(first);
+            if (input != NO_SYMBOL)
+            {
+                bool epsilons = input == 0 || t.is_flag(input);
+                runs.push_back(read_run(t, first, epsilons, input));
+            }
+        }
+        else
+        {
+            if (t.indices.input_symbol(address + 1) == 0)
+            {
+                runs.push_back(
+                    read_run(t, t.indices.target(address + 1) - TARGET_TABLE,
+                             true, 0));
+            }
+            for (SymbolNumber s = 1; s < input_symbols; ++s)
+            {
+                if (!t.is_flag(s) && t.indices.input_symbol(address + 1 + s) == s)
+                {
+                    runs.push_back(read_run(
+                        t, t.indices.target(address + 1 + s) - TARGET_TABLE,
+                        false, s));
+                }
+            }
+        }
+        runs.erase(std::remove_if(runs.begin(), runs.end(), is_empty_run),
+                   runs.end());
+        for (size_t r = 0; r < runs.size(); ++r)
+        {
+            std::stable_sort(runs[r].begin(), runs[r].end(),
+                             runs[r][0].input == 0 || t.is_flag(runs[r][0].input)
+                                 ? epsilons_lighter
+                                 : lighter);
+            for (size_t a = 0; a < runs[r].size(); ++a)
+            {
+                TransitionTableIndex target = runs[r][a].target;
+                std::map<TransitionTableIndex, size_t>::iterator it
+                    = numbers.find(target);
+                if (it != numbers.end())
+                {
+                    runs[r][a].target = it->second;
+                    continue;
+                }
+                State next = { target, false, 0.0,
+                               std::vector<std::vector<Arc> >(), false, 0 };
+                runs[r][a].target = states.size();
+                numbers[target] = states.size();
+                pending.push(states.size());
+                states.push_back(next);
+            }
+        }
+        State &state = states[number];
+        state.final = t.is_final(address);
+        state.final_weight = state.final ? t.final_weight(address) : 0.0;
+        state.runs.swap(runs);
+        state.indexed = number == 0 || state.runs.size() > 1;
+    }
+    return states;
+}
+
+// Least weight from each state to a final state, or an empty vector if
+// some weight is negative and the search bound would not hold.
+std::vector<Weight>
+min_costs_to_final(const std::vector<State> &states)
+{
+    const Weight infinity = std::numeric_limits<Weight>::infinity();
+    std::vector<std::vector<std::pair<size_t, Weight> > > incoming(
+        states.size());
+    std::vector<Weight> costs(states.size(), infinity);
+    typedef std::pair<Weight, size_t> Item;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item> > agenda;
+    for (size_t i = 0; i < states.size(); ++i)
+    {
+        if (states[i].final)
+        {
+            if (states[i].final_weight < 0.0)
+            {
+                return std::vector<Weight>();
+            }
+            costs[i] = states[i].final_weight;
+            agenda.push(Item(costs[i], i));
+        }
+        for (size_t r = 0; r < states[i].runs.size(); ++r)
+        {
+            for (size_t a = 0; a < states[i].runs[r].size(); ++a)
+            {
+                const Arc &arc = states[i].runs[r][a];
+                if (arc.weight < 0.0)
+                {
+                    return std::vector<Weight>();
+                }
+                incoming[arc.target].push_back(std::make_pair(i, arc.weight));
+            }
+        }
+    }
+    while (!agenda.empty())
+    {
+        Item item = agenda.top();
+        agenda.pop();
+        if (item.first > costs[item.second])
+        {
+            continue;
+        }
+        for (size_t i = 0; i < incoming[item.second].size(); ++i)
+        {
+            size_t source = incoming[item.second][i].first;
+            Weight cost = item.first + incoming[item.second][i].second;
+            if (cost < costs[source])
+            {
+                costs[source] = cost;
+                agenda.push(Item(cost, source));
+            }
+        }
+    }
+    return costs;
+}
+
+typedef std::map<TransitionTableIndex, unsigned long> Visits;
+
+// The start state, then the states visited in the trace from the busiest
+// down, then the rest in breadth first order
+std::vector<size_t>
+layout_order(const std::vector<State> &states, const Visits *visits)
+{
+    std::vector<std::pair<unsigned long, size_t> > keyed;
+    for (size_t i = 0; i < states.size(); ++i)
+    {
+        unsigned long count = 0;
+        if (visits != 0 && i != 0)
+        {
+            Visits::const_iterator it = visits->find(states[i].address);
+            if (it != visits->end())
+            {
+                count = it->second;
+            }
+        }
+        keyed.push_back(std::make_pair(count, i));
+    }
+    std::stable_sort(keyed.begin() + 1, keyed.end(),
+                     [](const std::pair<unsigned long, size_t> &a,
+                        const std::pair<unsigned long, size_t> &b) {
+                         return a.first > b.first;
+                     });
+    std::vector<size_t> order;
+    for (size_t i = 0; i < keyed.size(); ++i)
+    {
+        order.push_back(keyed[i].second);
+    }
+    return order;
+}
+
+std::string
+optimize_transducer(const std::string &data, const Visits *visits)
+{
+    TransducerParts parts = split_transducer(data);
+    std::string copy(data);
+    Transducer t(&copy[0]);
+    std::vector<State> states = read_states(t, parts.input_symbols);
+    std::vector<size_t> order = layout_order(states, visits);
+
+    // Pack the states with several input classes in the index table, first
+    // fit in layout order
+    std::vector<bool> used;
+    size_t first_free = 0;
+    TransitionTableIndex last_offset = 0;
+    for (size_t n = 0; n < order.size(); ++n)
+    {
+        size_t i = order[n];
+        if (!states[i].indexed)
+        {
+            continue;
+        }
+        std::vector<SymbolNumber> slots;
+        for (size_t r = 0; r < states[i].runs.size(); ++r)
+        {
+            SymbolNumber input = states[i].runs[r][0].input;
+            slots.push_back(t.is_flag(input) ? 0 : input);
+        }
+        size_t offset = first_free;
+        for (;; ++offset)
+        {
+            if (offset < used.size() && used[offset])
+            {
+                continue;
+            }
+            bool fits = true;
+            for (size_t s = 0; s < slots.size(); ++s)
+            {
+                size_t slot = offset + 1 + slots[s];
+                if (slot < used.size() && used[slot])
+                {
+                    fits = false;
+                    break;
+                }
+            }
+            if (fits)
+            {
+                break;
+            }
+        }
+        if (used.size() < offset + 2 + parts.input_symbols)
+        {
+            used.resize(offset + 2 + parts.input_symbols, false);
+        }
+        used[offset] = true;
+        for (size_t s = 0; s < slots.size(); ++s)
+        {
+            used[offset + 1 + slots[s]] = true;
+        }
+        while (first_free < used.size() && used[first_free])
+        {
+            ++first_free;
+        }
+        states[i].new_address = offset;
+        last_offset = std::max(last_offset,
+                               static_cast<TransitionTableIndex>(offset));
+    }
+
+    // Lay out the arcs in the same order, each block behind a state header
+    // so that no run continues into the next one
+    TransitionTableIndex transition_count = 0;
+    std::vector<std::vector<TransitionTableIndex> > run_starts(states.size());
+    for (size_t n = 0; n < order.size(); ++n)
+    {
+        size_t i = order[n];
+        if (!states[i].indexed)
+        {
+            states[i].new_address = TARGET_TABLE + transition_count;
+        }
+        else if (states[i].runs.empty())
+        {
+            continue;
+        }
+        ++transition_count;
+        for (size_t r = 0; r < states[i].runs.size(); ++r)
+        {
+            run_starts[i].push_back(transition_count);
+            transition_count += states[i].runs[r].size();
+        }
+    }
+    TransitionTableIndex index_count = last_offset + 1 + parts.input_symbols;
+
+    std::string indices;
+    std::vector<std::pair<SymbolNumber, TransitionTableIndex> > index_entries(
+        index_count, std::make_pair(NO_SYMBOL, NO_TABLE_INDEX));
+    std::string transitions;
+    TransitionTableIndex arc_count = 0;
+    for (size_t n = 0; n < order.size(); ++n)
+    {
+        size_t i = order[n];
+        const State &state = states[i];
+        if (state.indexed)
+        {
+            TransitionTableIndex final_bits = NO_TABLE_INDEX;
+            if (state.final)
+            {
+                memcpy(&final_bits, &state.final_weight, sizeof(final_bits));
+            }
+            index_entries[state.new_address]
+                = std::make_pair(NO_SYMBOL, final_bits);
+            for (size_t r = 0; r < state.runs.size(); ++r)
+            {
+                SymbolNumber input = state.runs[r][0].input;
+                SymbolNumber slot = t.is_flag(input) ? 0 : input;
+                index_entries[state.new_address + 1 + slot]
+                    = std::make_pair(slot, TARGET_TABLE + run_starts[i][r]);
+            }
+            if (!state.runs.empty())
+            {
+                put_transition(transitions, NO_SYMBOL, NO_SYMBOL,
+                               NO_TABLE_INDEX, 0.0);
+            }
+        }
+        else
+        {
+            put_transition(transitions, NO_SYMBOL, NO_SYMBOL,
+                           state.final ? 1 : NO_TABLE_INDEX,
+                           state.final ? state.final_weight : 0.0);
+        }
+        for (size_t r = 0; r < state.runs.size(); ++r)
+        {
+            for (size_t a = 0; a < state.runs[r].size(); ++a)
+            {
+                const Arc &arc = state.runs[r][a];
+                put_transition(transitions, arc.input, arc.output,
+                               states[arc.target].new_address, arc.weight);
+                ++arc_count;
+            }
+        }
+    }
+    for (size_t i = 0; i < index_entries.size(); ++i)
+    {
+        put_uint16(indices, index_entries[i].first);
+        put_uint32(indices, index_entries[i].second);
+    }
+
+    std::vector<Weight> costs = min_costs_to_final(states);
+    std::string cost_tables;
+    if (!costs.empty())
+    {
+        std::vector<Weight> index_costs(index_count, 0.0);
+        std::vector<Weight> transition_costs(transition_count, 0.0);
+        for (size_t i = 0; i < states.size(); ++i)
+        {
+            if (states[i].indexed)
+            {
+                index_costs[states[i].new_address] = costs[i];
+            }
+            else
+            {
+                transition_costs[states[i].new_address - TARGET_TABLE]
+                    = costs[i];
+            }
+        }
+        put_uint32(cost_tables, index_costs.size());
+        for (size_t i = 0; i < index_costs.size(); ++i)
+        {
+            put_weight(cost_tables, index_costs[i]);
+        }
+        put_uint32(cost_tables, transition_costs.size());
+        for (size_t i = 0; i < transition_costs.size(); ++i)
+        {
+            put_weight(cost_tables, transition_costs[i]);
+        }
+    }
+    else if (verbose)
+    {
+        std::cerr << "Negative weights, not storing least costs to final\n";
+    }
+
+    std::string properties;
+    for (size_t i = 0; i < parts.properties.size(); ++i)
+    {
+        if (parts.properties[i].first == hfst_ospell::MIN_COST_PROPERTY
+            || parts.properties[i].first == hfst_ospell::SORTED_RUNS_PROPERTY)
+        {
+            continue;
+        }
+        properties += parts.properties[i].first + '\0';
+        properties += parts.properties[i].second + '\0';
+    }
+    properties += std::string(hfst_ospell::SORTED_RUNS_PROPERTY) + '\0';
+    properties += std::string("true") + '\0';
+    if (!costs.empty())
+    {
+        properties += std::string(hfst_ospell::MIN_COST_PROPERTY) + '\0';
+        properties += std::string("true") + '\0';
+    }
+
+    std::string out("HFST\0", 5);
+    put_uint16(out, static_cast<uint16_t>(properties.size()));
+    out += '\0';
+    out += properties;
+    put_uint16(out, parts.input_symbols);
+    put_uint16(out, parts.symbols);
+    put_uint32(out, index_count);
+    put_uint32(out, transition_count);
+    put_uint32(out, states.size());
+    put_uint32(out, arc_count);
+    out += parts.header_flags;
+    out += parts.alphabet;
+    out += indices;
+    out += transitions;
+    out += cost_tables;
+    if (verbose)
+    {
+        std::cerr << states.size() << " states, " << arc_count
+                  << " arcs, index table " << index_count
+                  << " entries, transition table " << transition_count
+                  << " entries\n";
+    }
+    return out;
+}
+
+bool
+read_file(const std::string &filename, std::string &data)
+{
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in)
+    {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    data = buffer.str();
+    return true;
+}
+
+bool
+write_file(const std::string &filename, const std::string &data)
+{
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    out.write(data.data(), data.size());
+    return static_cast<bool>(out);
+}
+
+bool
+is_automaton_entry(const std::string &name)
+{
+    return (name.compare(0, 9, "acceptor.") == 0
+            || name.compare(0, 9, "errmodel.") == 0)
+           && name.size() > 5 && name.compare(name.size() - 5, 5, ".hfst") == 0;
+}
+
+#if HAVE_LIBARCHIVE
+int
+optimize_zhfst(const std::string &input, const std::string &output)
+{
+    struct archive *ar = archive_read_new();
+#if USE_LIBARCHIVE_2
+    archive_read_support_compression_all(ar);
+#else
+    archive_read_support_filter_all(ar);
+#endif // USE_LIBARCHIVE_2
+    archive_read_support_format_all(ar);
+    if (archive_read_open_filename(ar, input.c_str(), 10240) != ARCHIVE_OK)
+    {
+        std::cerr << "cannot read zhfst archive " << input << ": "
+                  << archive_error_string(ar) << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<std::pair<std::string, std::string> > entries;
+    struct archive_entry *entry = 0;
+    while (archive_read_next_header(ar, &entry) == ARCHIVE_OK)
+    {
+        std::string name = archive_entry_pathname(entry);
+        std::string data(archive_entry_size(entry), '\0');
+        size_t length = 0;
+        while (length < data.size())
+        {
+            ssize_t got
+                = archive_read_data(ar, &data[length], data.size() - length);
+            if (got == ARCHIVE_RETRY)
+            {
+                continue;
+            }
+            if (got <= 0)
+            {
+                std::cerr << "cannot read " << name << " from " << input
+                          << std::endl;
+                return EXIT_FAILURE;
+            }
+            length += got;
+        }
+        entries.push_back(std::make_pair(name, data));
+    }
+    archive_read_close(ar);
+#if USE_LIBARCHIVE_2
+    archive_read_finish(ar);
+#else
+    archive_read_free(ar);
+#endif // USE_LIBARCHIVE_2
+
+    struct archive *aw = archive_write_new();
+    archive_write_set_format_zip(aw);
+    // libarchive has no way to align the entries, but stored entries can
+    // at least be used without inflating them
+    archive_write_set_options(aw, "zip:compression=store");
+    if (archive_write_open_filename(aw, output.c_str()) != ARCHIVE_OK)
+    {
+        std::cerr << "cannot write " << output << ": "
+                  << archive_error_string(aw) << std::endl;
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const std::string &name = entries[i].first;
+        std::string data;
+        if (name.compare(0, 6, "cache.") == 0
+            || name.compare(0, 12, "completions.") == 0)
+        {
+            // the caches and completion indexes hold state numbers of the
+            // old automata and no longer apply
+            if (verbose)
+            {
+                std::cerr << "Dropping " << name << std::endl;
+            }
+            continue;
+        }
+        else if (is_automaton_entry(name))
+        {
+            if (verbose)
+            {
+                std::cerr << "Optimizing " << name << ": ";
+            }
+            data = optimize_transducer(
+                entries[i].second, name.compare(0, 9, "acceptor.") == 0
+                                       ? &trace.lexicon
+                                       : &trace.mutator);
+        }
+        else
+        {
+            data = entries[i].second;
+        }
+        struct archive_entry *out_entry = archive_entry_new();
+        archive_entry_set_pathname(out_entry, name.c_str());
+        archive_entry_set_size(out_entry, data.size());
+        archive_entry_set_filetype(out_entry, AE_IFREG);
+        archive_entry_set_perm(out_entry, 0644);
+        if (archive_write_header(aw, out_entry) != ARCHIVE_OK
+            || archive_write_data(aw, data.data(), data.size())
+                   != static_cast<ssize_t>(data.size()))
+        {
+            std::cerr << "cannot write " << name << " to " << output << ": "
+                      << archive_error_string(aw) << std::endl;
+            archive_entry_free(out_entry);
+            return EXIT_FAILURE;
+        }
+        archive_entry_free(out_entry);
+    }
+    archive_write_close(aw);
+#if USE_LIBARCHIVE_2
+    archive_write_finish(aw);
+#else
+    archive_write_free(aw);
+#endif // USE_LIBARCHIVE_2
+    return EXIT_SUCCESS;
+}
+#endif // HAVE_LIBARCHIVE
+
+} // namespace
+
+bool
+print_usage(void)
+{
+    std::cout
+        << "\n"
+        << "Usage: " PACKAGE_NAME "-optimize [OPTIONS] INPUT OUTPUT\n"
+        << "Rewrite the automata of speller INPUT for faster search into "
+           "OUTPUT,\n"
+           "a ZHFST archive or a single optimized-lookup automaton\n"
+           "\n"
+        << "  -h, --help                Print this help message\n"
+        << "  -V, --version             Print version information\n"
+        << "  -v, --verbose             Be verbose\n"
+        << "  -q, --quiet               Don't be verbose (default)\n"
+        << "  -s, --silent              Same as quiet\n"
+        << "  -t, --trace=FILE          Put the states most visited in FILE, "
+           "written by\n"
+           "                            hfst-ospell --trace-states, first in "
+           "the tables\n"
+        << "\n"
+        << "Report bugs to " PACKAGE_BUGREPORT "\n"
+        << "\n";
+    return true;
+}
+
+bool
+print_version(void)
+{
+    std::cout << "\n" PACKAGE_STRING << std::endl
+              << "copyright (C) 2009 - 2022 University of Helsinki\n";
+    return true;
+}
+
+int
+main(int argc, char **argv)
+{
+#if HAVE_GETOPT_H
+    int c;
+    while (true)
+    {
+        static struct option long_options[]
+            = { // first the hfst-mandated options
+                { "help", no_argument, 0, 'h' },
+                { "version", no_argument, 0, 'V' },
+                { "verbose", no_argument, 0, 'v' },
+                { "quiet", no_argument, 0, 'q' },
+                { "silent", no_argument, 0, 's' },
+                { "trace", required_argument, 0, 't' },
+                { 0, 0, 0, 0 }
+              };
+
+        int option_index = 0;
+        c = getopt_long(argc, argv, "hVvqst:", long_options, &option_index);
+
+        if (c == -1) // no more options to look at
+            break;
+
+        switch (c)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+
+        case 'V':
+            print_version();
+            return EXIT_SUCCESS;
+            break;
+
+        case 'v':
+            verbose = true;
+            break;
+
+        case 'q': // fallthrough
+        case 's':
+            verbose = false;
+            break;
+
+        case 't':
+        {
+            std::string data;
+            if (!read_file(optarg, data) || !trace.load(data))
+            {
+                std::cerr << "cannot read state trace " << optarg
+                          << std::endl;
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+
+        default:
+            std::cerr << "Invalid option\n\n";
+            print_usage();
+            return EXIT_FAILURE;
+            break;
+        }
+    }
+#else
+    int optind = 1;
+#endif
+    if (argc - optind != 2)
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    std::string input = argv[optind];
+    std::string output = argv[optind + 1];
+    try
+    {
+        if (input.size() > 6 && input.compare(input.size() - 6, 6, ".zhfst") == 0)
+        {
+#if HAVE_LIBARCHIVE
+            return optimize_zhfst(input, output);
+#else
+            std::cerr << "Archive support was not compiled in\n";
+            return EXIT_FAILURE;
+#endif // HAVE_LIBARCHIVE
+        }
+        std::string data;
+        if (!read_file(input, data))
+        {
+            std::cerr << "cannot read " << input << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (!write_file(output, optimize_transducer(data, &trace.lexicon)))
+        {
+            std::cerr << "cannot write " << output << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    catch (hfst_ospell::OspellException &e)
+    {
+        std::cerr << "cannot optimize " << input << ": " << e.what()
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -16,10 +16,35 @@
 #  include <config.h>
 #endif
 
+#include <atomic>
+#include <future>
+#include <thread>
+#include <algorithm>
+#include <sstream>
+
 #include "ospell.h"
+#include "case-table.h"
 
 namespace hfst_ospell {
 
+//! error models with more states times input symbols than this are
+//! searched through their tables
+static const size_t MUTATOR_TABLE_MAX_CELLS = 1 << 22;
+//! and its output sets are left out past this many words
+static const size_t MUTATOR_OUTPUT_SETS_MAX_WORDS = 1 << 21;
+//! symbol sets of lexicon states stop being added past this many words
+static const size_t LEXICON_SYMBOL_SETS_MAX_WORDS = 1 << 20;
+//! completions kept per lexicon state unless set otherwise
+static const unsigned int COMPLETION_COUNT = 10;
+//! states outside the completion index memoized at most
+static const size_t COMPLETION_MEMO_MAX_STATES = 4096;
+//! search nodes a CorrectionSession keeps for all prefixes at most
+static const size_t SESSION_MAX_NODES = 1 << 16;
+//! the search for the completions of a state stops after this many nodes
+static const unsigned long COMPLETION_MAX_NODES = 100000;
+//! and does not look for completions longer than this many symbols
+static const size_t COMPLETION_MAX_LENGTH = 64;
+
 int nByte_utf8(unsigned char c)
 {
     /* utility function to determine how many bytes to peel off as
@@ -37,6 +62,130 @@ int nByte_utf8(unsigned char c)
     }
 }
 
+static bool in_case_range(const CaseRange & range, unsigned int c)
+{
+    return c >= range.first && c <= range.last &&
+        (!range.alternating || (c - range.first) % 2 == 0);
+}
+
+static unsigned int lower_case(unsigned int c)
+{
+    const CaseRange * end = CASE_RANGES +
+        sizeof(CASE_RANGES) / sizeof(CASE_RANGES[0]);
+    const CaseRange * range = std::upper_bound(
+        CASE_RANGES, end, c,
+        [](unsigned int code, const CaseRange & r) { return code < r.first; });
+    if (range != CASE_RANGES && in_case_range(*(range - 1), c)) {
+        return c + (range - 1)->delta;
+    }
+    return c;
+}
+
+static unsigned int upper_case(unsigned int c)
+{
+    for (auto& range : CASE_RANGES) {
+        if (in_case_range(range, c - range.delta)) {
+            return c - range.delta;
+        }
+    }
+    return c;
+}
+
+//! the code point at @a p, which is moved past it, or 0 if it is not
+//! valid UTF-8
+static unsigned int next_code_point(const char *& p)
+{
+    unsigned char c = *p;
+    int length = nByte_utf8(c);
+    if (length == 0) {
+        return 0;
+    }
+    unsigned int code = (length == 1) ? c : (c & (0x7F >> length));
+    for (int i = 1; i < length; ++i) {
+        unsigned char next = p[i];
+        if ((next & 0xC0) != 0x80) {
+            return 0;
+        }
+        code = (code << 6) | (next & 0x3F);
+    }
+    p += length;
+    return code;
+}
+
+static void append_code_point(std::string & out, unsigned int code)
+{
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+//! how the letters of a word are capitalized
+enum Capitalization { NoCapitals, FirstCapital, AllCapitals };
+
+static Capitalization capitalization(const char * word)
+{
+    unsigned int letters = 0;
+    bool first_capital = false;
+    bool all_capitals = true;
+    while (*word != '\0') {
+        unsigned int c = next_code_point(word);
+        if (c == 0) {
+            break;
+        }
+        bool capital = lower_case(c) != c;
+        if (!capital && upper_case(c) == c) {
+            // not a letter with case
+            continue;
+        }
+        if (letters == 0) {
+            first_capital = capital;
+        }
+        all_capitals = all_capitals && capital;
+        ++letters;
+    }
+    if (letters > 1 && all_capitals) {
+        return AllCapitals;
+    }
+    return first_capital ? FirstCapital : NoCapitals;
+}
+
+//! @a word with its first or all letters made capital as @a how says
+static std::string capitalize(std::string word, Capitalization how)
+{
+    if (how == NoCapitals) {
+        return word;
+    }
+    std::string result;
+    const char * p = word.c_str();
+    while (*p != '\0') {
+        const char * start = p;
+        unsigned int c = next_code_point(p);
+        if (c == 0) {
+            // leave the rest as it is
+            result.append(start);
+            break;
+        }
+        append_code_point(result, upper_case(c));
+        if (how == FirstCapital) {
+            result.append(p);
+            break;
+        }
+    }
+    return result;
+}
+
 void WeightQueue::push(Weight w)
 {
     for (WeightQueue::iterator it = begin(); it != end(); ++it) {
@@ -76,7 +225,12 @@ Transducer::Transducer(FILE* f):
     encoder(keys,header.input_symbol_count()),
     indices(f,header.index_table_size()),
     transitions(f,header.target_table_size())
-    {}
+    {
+        if (header.get_property(MIN_COST_PROPERTY) != "") {
+            read_min_costs(f);
+        }
+        prepare_runs();
+    }
 
 Transducer::Transducer(char* raw):
     header(TransducerHeader(&raw)),
@@ -85,11 +239,84 @@ Transducer::Transducer(char* raw):
     encoder(keys,header.input_symbol_count()),
     indices(&raw,header.index_table_size()),
     transitions(&raw,header.target_table_size())
-    {}
+    {
+        if (header.get_property(MIN_COST_PROPERTY) != "") {
+            read_min_costs(&raw);
+        }
+        prepare_runs();
+    }
+
+void Transducer::prepare_runs(void)
+{
+    if (header.get_property(SORTED_RUNS_PROPERTY) != "") {
+        // the optimizer only stores least costs when no weight is negative
+        nonnegative_arcs = has_min_costs();
+    } else {
+        nonnegative_arcs = transitions.sort_runs();
+    }
+}
+
+// The least costs follow the transition table as a count and that many
+// floats, first for the index table and then for the transition table.
+static void flip_min_costs(std::vector<Weight> & costs)
+{
+    for (size_t i = 0; i < costs.size(); ++i) {
+        char * p = reinterpret_cast<char *>(&costs[i]);
+        std::swap(p[0], p[3]);
+        std::swap(p[1], p[2]);
+    }
+}
+
+void Transducer::read_min_costs(FILE * f)
+{
+    std::vector<Weight> * tables[] = {&index_min_costs,
+                                      &transition_min_costs};
+    for (size_t t = 0; t < 2; ++t) {
+        uint32_t count = 0;
+        if (is_big_endian()) {
+            count = read_uint32_flipping_endianness(f);
+        } else if (fread(&count, sizeof(count), 1, f) != 1) {
+            HFSTOSPELL_THROW_MESSAGE(HeaderParsingException,
+                                     "Least cost table ended unexpectedly\n");
+        }
+        tables[t]->resize(count);
+        if (count > 0 &&
+            fread(&(*tables[t])[0], sizeof(Weight), count, f) != count) {
+            HFSTOSPELL_THROW_MESSAGE(HeaderParsingException,
+                                     "Least cost table ended unexpectedly\n");
+        }
+        if (is_big_endian()) {
+            flip_min_costs(*tables[t]);
+        }
+    }
+}
+
+void Transducer::read_min_costs(char ** raw)
+{
+    std::vector<Weight> * tables[] = {&index_min_costs,
+                                      &transition_min_costs};
+    for (size_t t = 0; t < 2; ++t) {
+        uint32_t count = 0;
+        if (is_big_endian()) {
+            count = read_uint32_flipping_endianness(*raw);
+        } else {
+            memcpy(&count, *raw, sizeof(count));
+        }
+        (*raw) += sizeof(count);
+        tables[t]->resize(count);
+        if (count > 0) {
+            memcpy(&(*tables[t])[0], *raw, count * sizeof(Weight));
+        }
+        (*raw) += count * sizeof(Weight);
+        if (is_big_endian()) {
+            flip_min_costs(*tables[t]);
+        }
+    }
+}
 
 TreeNode TreeNode::update_lexicon(SymbolNumber symbol,
                                   TransitionTableIndex next_lexicon,
-                                  Weight weight)
+                                  Weight weight) const
 {
     SymbolVector str(this->string);
     if (symbol != 0) {
@@ -202,7 +429,25 @@ Speller::Speller(Transducer* mutator_ptr, Transducer* lexicon_ptr):
         next_node(FlagDiacriticState(get_state_size(), 0)),
         limit(std::numeric_limits<Weight>::max()),
         alphabet_translator(SymbolVector()),
+        mutator_table(new MutatorTable()),
         operations(lexicon->get_operations()),
+        cache_size(0),
+        cache_budget(0),
+        automata_hash(0),
+        automata_hashed(false),
+        use_min_costs(lexicon->has_min_costs() &&
+                      (mutator == NULL || mutator->has_min_costs())),
+        lexicon_has_flags(!lexicon->get_operations()->empty()),
+        lexicon_has_identity(lexicon->get_identity() != NO_SYMBOL),
+        tracing(false),
+        suffix_memo_size(0),
+        suffix_memo_budget(0),
+        suffix_memo_length(4),
+        query_count(0),
+        node_budget(0),
+        truncated(false),
+        case_folding(false),
+        completion_count(COMPLETION_COUNT),
         limiting(None),
         mode(Correct),
         max_time(-1.0),
@@ -212,12 +457,55 @@ Speller::Speller(Transducer* mutator_ptr, Transducer* lexicon_ptr):
             {
                 if (mutator != NULL) {
                     build_alphabet_translator();
+                    std::shared_ptr<MutatorTable> table(new MutatorTable());
+                    table->build(
+                        mutator, alphabet_translator,
+                        lexicon->get_alphabet()->get_orig_symbol_count(),
+                        MUTATOR_TABLE_MAX_CELLS);
+                    mutator_table = table;
                     cache = std::vector<CacheContainer>(
                         mutator->get_key_table()->size(), CacheContainer());
                 }
             }
 
 
+Speller::Speller(const Speller & other, SearchClone):
+        mutator(other.mutator),
+        lexicon(other.lexicon),
+        input(),
+        queue(TreeNodeQueue()),
+        next_node(FlagDiacriticState(get_state_size(), 0)),
+        limit(std::numeric_limits<Weight>::max()),
+        alphabet_translator(other.alphabet_translator),
+        mutator_table(other.mutator_table),
+        operations(other.operations),
+        cache(other.cache.size(), CacheContainer()),
+        cache_size(0),
+        cache_budget(0),
+        automata_hash(other.automata_hash),
+        automata_hashed(other.automata_hashed),
+        use_min_costs(other.use_min_costs),
+        lexicon_has_flags(other.lexicon_has_flags),
+        lexicon_has_identity(other.lexicon_has_identity),
+        tracing(other.tracing),
+        suffix_memo_size(0),
+        suffix_memo_budget(0),
+        suffix_memo_length(other.suffix_memo_length),
+        query_count(0),
+        node_budget(other.node_budget),
+        truncated(false),
+        case_folding(other.case_folding),
+        lexicon_case_variants(other.lexicon_case_variants),
+        mutator_case_variants(other.mutator_case_variants),
+        completion_count(other.completion_count),
+        limiting(None),
+        mode(Correct),
+        max_time(-1.0),
+        start_clock(0),
+        call_counter(0),
+        limit_reached(false)
+            {}
+
 SymbolNumber
 Speller::get_state_size()
 {
@@ -227,22 +515,44 @@ Speller::get_state_size()
 
 void Speller::lexicon_epsilons(void)
 {
-    if (!lexicon->has_epsilons_or_flags(next_node.lexicon_state + 1)) {
+    if (mode == Correct) {
+        if (lexicon_has_flags) {
+            lexicon_epsilons_kernel<true, true>();
+        } else {
+            lexicon_epsilons_kernel<true, false>();
+        }
+    } else {
+        if (lexicon_has_flags) {
+            lexicon_epsilons_kernel<false, true>();
+        } else {
+            lexicon_epsilons_kernel<false, false>();
+        }
+    }
+}
+
+template <bool correcting, bool flags>
+void Speller::lexicon_epsilons_kernel(void)
+{
+    // without flags in the alphabet only the epsilons need looking at
+    if (flags ? !lexicon->has_epsilons_or_flags(next_node.lexicon_state + 1)
+        : !lexicon->has_transitions(next_node.lexicon_state + 1, 0)) {
         return;
     }
     TransitionTableIndex next = lexicon->next(next_node.lexicon_state, 0);
-    STransition i_s = lexicon->take_epsilons_and_flags(next);
+    STransition i_s = flags ? lexicon->take_epsilons_and_flags(next)
+        : lexicon->take_epsilons(next);
 
     while (i_s.symbol != NO_SYMBOL) {
-        if (is_under_weight_limit(next_node.weight + i_s.weight)) {
-            if (lexicon->transitions.input_symbol(next) == 0) {
-                queue.push_back(next_node.update_lexicon((mode == Correct) ? 0 : i_s.symbol,
+        if (is_under_weight_limit(next_node.weight + i_s.weight,
+                                  next_node.mutator_state, i_s.index)) {
+            if (!flags || lexicon->transitions.input_symbol(next) == 0) {
+                queue.push_back(next_node.update_lexicon(correcting ? 0 : i_s.symbol,
                                                          i_s.index,
                                                          i_s.weight));
             } else {
                 FlagDiacriticState old_flags = next_node.flag_state;
                 if (next_node.try_compatible_with( // this is terrible
-                        operations->operator[](
+                        operations->at(
                             lexicon->transitions.input_symbol(next)))) {
                     queue.push_back(next_node.update_lexicon(0,
                                                              i_s.index,
@@ -252,7 +562,8 @@ void Speller::lexicon_epsilons(void)
             }
         }
         ++next;
-        i_s = lexicon->take_epsilons_and_flags(next);
+        i_s = flags ? lexicon->take_epsilons_and_flags(next)
+            : lexicon->take_epsilons(next);
     }
 }
 
@@ -271,6 +582,16 @@ void Speller::lexicon_consume(void)
         // for the case with plain lexicon symbols
         this_input = input[input_state];
     }
+    lexicon_consume_symbol(this_input);
+    if (case_folding && mode == Check) {
+        for (auto variant : lexicon_case_variants[this_input]) {
+            lexicon_consume_symbol(variant);
+        }
+    }
+}
+
+void Speller::lexicon_consume_symbol(SymbolNumber this_input)
+{
     if(!lexicon->has_transitions(
            next_node.lexicon_state + 1, this_input)) {
         // we have no regular transitions for this
@@ -302,17 +623,47 @@ void Speller::queue_lexicon_arcs(SymbolNumber input_sym,
                                  unsigned int mutator_state,
                                  Weight mutator_weight,
                                  int input_increment)
+{
+    if (mode == Correct) {
+        if (lexicon_has_identity) {
+            queue_lexicon_arcs_kernel<true, true>(
+                input_sym, mutator_state, mutator_weight, input_increment);
+        } else {
+            queue_lexicon_arcs_kernel<true, false>(
+                input_sym, mutator_state, mutator_weight, input_increment);
+        }
+    } else {
+        if (lexicon_has_identity) {
+            queue_lexicon_arcs_kernel<false, true>(
+                input_sym, mutator_state, mutator_weight, input_increment);
+        } else {
+            queue_lexicon_arcs_kernel<false, false>(
+                input_sym, mutator_state, mutator_weight, input_increment);
+        }
+    }
+}
+
+template <bool correcting, bool identity>
+void Speller::queue_lexicon_arcs_kernel(SymbolNumber input_sym,
+                                        unsigned int mutator_state,
+                                        Weight mutator_weight,
+                                        int input_increment)
 {
     TransitionTableIndex next = lexicon->next(next_node.lexicon_state,
                                               input_sym);
     STransition i_s = lexicon->take_non_epsilons(next, input_sym);
     while (i_s.symbol != NO_SYMBOL) {
-        if (i_s.symbol == lexicon->get_identity()) {
+        if (identity && i_s.symbol == lexicon->get_identity()) {
             i_s.symbol = input[next_node.input_state];
         }
-        if (is_under_weight_limit(next_node.weight + i_s.weight + mutator_weight)) {
+        Weight weight = next_node.weight + i_s.weight + mutator_weight;
+        if (!is_under_weight_limit(weight)) {
+            // the rest of the run weighs at least as much
+            break;
+        }
+        if (is_under_weight_limit(weight, mutator_state, i_s.index)) {
             queue.push_back(next_node.update(
-                                (mode == Correct) ? input_sym : i_s.symbol,
+                                correcting ? input_sym : i_s.symbol,
                                 next_node.input_state + input_increment,
                                 mutator_state,
                                 i_s.index,
@@ -325,6 +676,16 @@ void Speller::queue_lexicon_arcs(SymbolNumber input_sym,
 
 void Speller::mutator_epsilons(void)
 {
+    if (!mutator_table->empty()) {
+        const MutatorArc * arc;
+        const MutatorArc * last;
+        const uint64_t * outputs;
+        if (mutator_table->find(next_node.mutator_state, 0,
+                               arc, last, outputs)) {
+            queue_mutator_table_arcs(arc, last, outputs, 0);
+        }
+        return;
+    }
     if (!mutator->has_transitions(next_node.mutator_state + 1, 0)) {
         return;
     }
@@ -332,9 +693,16 @@ void Speller::mutator_epsilons(void)
     STransition mutator_i_s = mutator->take_epsilons(next_m);
 
     while (mutator_i_s.symbol != NO_SYMBOL) {
+        if (lexicon->has_nonnegative_arcs() &&
+            !is_under_weight_limit(next_node.weight + mutator_i_s.weight)) {
+            // the rest of the run weighs at least as much, and the lexicon
+            // can only add to it
+            break;
+        }
         if (mutator_i_s.symbol == 0) {
             if (is_under_weight_limit(
-                    next_node.weight + mutator_i_s.weight)) {
+                    next_node.weight + mutator_i_s.weight,
+                    mutator_i_s.index, next_node.lexicon_state)) {
                 queue.push_back(next_node.update_mutator(mutator_i_s.index,
                                                          mutator_i_s.weight));
             }
@@ -381,12 +749,63 @@ bool Speller::is_under_weight_limit(Weight w) const
     return w <= limit;
 }
 
+bool Speller::is_under_weight_limit(Weight w,
+                                    TransitionTableIndex mutator_state,
+                                    TransitionTableIndex lexicon_state) const
+{
+    if (!is_under_weight_limit(w)) {
+        return false;
+    }
+    if (!use_min_costs || mode != Correct) {
+        return true;
+    }
+    // Only drop the node when even its cheapest completion is over the
+    // limit, so ties with the limit are decided as before
+    Weight least = w + lexicon->min_cost(lexicon_state);
+    if (mutator != NULL) {
+        least += mutator->min_cost(mutator_state);
+    }
+    return least <= limit;
+}
+
 void Speller::consume_input()
 {
     if (next_node.input_state >= input.size()) {
         return; // not enough input to consume
     }
     SymbolNumber input_sym = input[next_node.input_state];
+    consume_input_symbol(input_sym);
+    if (case_folding && mutator != NULL) {
+        for (auto variant : mutator_case_variants[input_sym]) {
+            consume_input_symbol(variant);
+        }
+    }
+}
+
+void Speller::consume_input_symbol(SymbolNumber input_sym)
+{
+    if (!mutator_table->empty()) {
+        const MutatorArc * arc;
+        const MutatorArc * last;
+        const uint64_t * outputs;
+        if (mutator_table->find(next_node.mutator_state, input_sym,
+                               arc, last, outputs)) {
+            queue_mutator_table_arcs(arc, last, outputs, 1);
+        } else if (input_sym >=
+                   mutator->get_alphabet()->get_orig_symbol_count()) {
+            if (mutator_table->find(next_node.mutator_state,
+                                   mutator->get_identity(),
+                                   arc, last, outputs)) {
+                queue_mutator_table_arcs(arc, last, outputs, 1);
+            }
+            if (mutator_table->find(next_node.mutator_state,
+                                   mutator->get_unknown(),
+                                   arc, last, outputs)) {
+                queue_mutator_table_arcs(arc, last, outputs, 1);
+            }
+        }
+        return;
+    }
     if (!mutator->has_transitions(next_node.mutator_state + 1,
                                   input_sym)) {
         // we have no regular transitions for this
@@ -416,9 +835,15 @@ void Speller::queue_mutator_arcs(SymbolNumber input_sym)
     STransition mutator_i_s = mutator->take_non_epsilons(next_m,
                                                          input_sym);
     while (mutator_i_s.symbol != NO_SYMBOL) {
+        if (lexicon->has_nonnegative_arcs() &&
+            !is_under_weight_limit(next_node.weight + mutator_i_s.weight)) {
+            // as in mutator_epsilons()
+            break;
+        }
         if (mutator_i_s.symbol == 0) {
             if (is_under_weight_limit(
-                    next_node.weight + mutator_i_s.weight)) {
+                    next_node.weight + mutator_i_s.weight,
+                    mutator_i_s.index, next_node.lexicon_state)) {
                 queue.push_back(next_node.update(0, next_node.input_state + 1,
                                                  mutator_i_s.index,
                                                  next_node.lexicon_state,
@@ -459,6 +884,184 @@ void Speller::queue_mutator_arcs(SymbolNumber input_sym)
     }
 }
 
+void Speller::queue_mutator_table_arcs(const MutatorArc * arc,
+                                       const MutatorArc * last,
+                                       const uint64_t * outputs,
+                                       int input_increment)
+{
+    // The same walk as queue_mutator_arcs() and mutator_epsilons(), with
+    // the outputs already translated
+    const uint64_t * accepted = outputs == NULL ? NULL : lexicon_symbol_set();
+    if (accepted != NULL && (outputs[0] & 1) == 0) {
+        // every arc writes a lexicon symbol, so there is nothing to do
+        // unless the lexicon state takes one of them
+        uint64_t common = 0;
+        for (size_t w = 0; w < mutator_table->get_output_words(); ++w) {
+            common |= outputs[w] & accepted[w];
+        }
+        if (common == 0) {
+            return;
+        }
+    }
+    for (; arc != last; ++arc) {
+        if (lexicon->has_nonnegative_arcs() &&
+            !is_under_weight_limit(next_node.weight + arc->weight)) {
+            break;
+        }
+        if (accepted != NULL && arc->output != 0 &&
+            arc->output < lexicon->get_alphabet()->get_orig_symbol_count()) {
+            if ((accepted[arc->output / 64] >> (arc->output % 64)) & 1) {
+                queue_lexicon_arcs(arc->output, arc->target, arc->weight,
+                                   input_increment);
+            }
+        } else if (arc->output == 0) {
+            if (is_under_weight_limit(next_node.weight + arc->weight,
+                                      arc->target, next_node.lexicon_state)) {
+                queue.push_back(next_node.update(
+                                    0, next_node.input_state + input_increment,
+                                    arc->target, next_node.lexicon_state,
+                                    arc->weight));
+            }
+        } else if (lexicon->has_transitions(next_node.lexicon_state + 1,
+                                            arc->output)) {
+            queue_lexicon_arcs(arc->output, arc->target, arc->weight,
+                               input_increment);
+        } else if (arc->output >=
+                   lexicon->get_alphabet()->get_orig_symbol_count()) {
+            // unknown or identity may apply
+            if (lexicon->get_unknown() != NO_SYMBOL &&
+                lexicon->has_transitions(next_node.lexicon_state + 1,
+                                         lexicon->get_unknown())) {
+                queue_lexicon_arcs(lexicon->get_unknown(), arc->target,
+                                   arc->weight, input_increment);
+            }
+            if (lexicon->get_identity() != NO_SYMBOL &&
+                lexicon->has_transitions(next_node.lexicon_state + 1,
+                                         lexicon->get_identity())) {
+                queue_lexicon_arcs(lexicon->get_identity(), arc->target,
+                                   arc->weight, input_increment);
+            }
+        }
+    }
+}
+
+const uint64_t * Speller::lexicon_symbol_set(void)
+{
+    size_t words = mutator_table->get_output_words();
+    if (words == 0) {
+        return NULL;
+    }
+    SymbolNumber symbols = lexicon->get_alphabet()->get_orig_symbol_count();
+    TransitionTableIndex state = next_node.lexicon_state;
+    if (state >= TARGET_TABLE) {
+        // only the symbol of the first arc is looked at in these
+        lexicon_symbol_scratch.assign(words, 0);
+        SymbolNumber sym =
+            lexicon->transitions.input_symbol(state - TARGET_TABLE + 1);
+        if (sym != 0 && sym < symbols) {
+            lexicon_symbol_scratch[sym / 64] |= uint64_t(1) << (sym % 64);
+        }
+        return lexicon_symbol_scratch.data();
+    }
+    std::unordered_map<TransitionTableIndex, size_t>::const_iterator it =
+        lexicon_symbol_sets.find(state);
+    if (it != lexicon_symbol_sets.end()) {
+        return lexicon_symbol_bits.data() + it->second;
+    }
+    if (lexicon_symbol_bits.size() + words > LEXICON_SYMBOL_SETS_MAX_WORDS) {
+        return NULL;
+    }
+    size_t offset = lexicon_symbol_bits.size();
+    lexicon_symbol_bits.resize(offset + words, 0);
+    for (SymbolNumber sym = 1; sym < symbols; ++sym) {
+        if (lexicon->has_transitions(state + 1, sym)) {
+            lexicon_symbol_bits[offset + sym / 64] |=
+                uint64_t(1) << (sym % 64);
+        }
+    }
+    lexicon_symbol_sets[state] = offset;
+    return lexicon_symbol_bits.data() + offset;
+}
+
+bool MutatorTable::build(Transducer * mutator,
+                         const SymbolVector & translator,
+                         SymbolNumber lexicon_symbols,
+                         size_t max_cells)
+{
+    symbols = mutator->get_alphabet()->get_orig_symbol_count();
+    std::vector<TransitionTableIndex> states(1, 0);
+    std::unordered_map<TransitionTableIndex, uint32_t> ids;
+    ids[0] = 1;
+    offsets.assign(1, 0);
+    arcs.clear();
+    for (size_t n = 0; n < states.size(); ++n) {
+        if ((n + 1) * symbols > max_cells) {
+            offsets.clear();
+            arcs.clear();
+            output_words = 0;
+            return false;
+        }
+        TransitionTableIndex state = states[n];
+        for (SymbolNumber input = 0; input < symbols; ++input) {
+            if (mutator->has_transitions(state + 1, input)) {
+                TransitionTableIndex i = mutator->next(state, input);
+                STransition arc = mutator->take_non_epsilons(i, input);
+                while (arc.symbol != NO_SYMBOL) {
+                    if (ids.insert(std::make_pair(
+                                       arc.index,
+                                       static_cast<uint32_t>(states.size() + 1)))
+                        .second) {
+                        states.push_back(arc.index);
+                    }
+                    MutatorArc compiled = { translator[arc.symbol],
+                                            arc.index, arc.weight };
+                    arcs.push_back(compiled);
+                    arc = mutator->take_non_epsilons(++i, input);
+                }
+            }
+            offsets.push_back(static_cast<uint32_t>(arcs.size()));
+        }
+    }
+    size_t cells = offsets.size() - 1;
+    output_words = (lexicon_symbols + 63) / 64;
+    if (cells * output_words > MUTATOR_OUTPUT_SETS_MAX_WORDS) {
+        output_words = 0;
+    }
+    output_sets.assign(cells * output_words, 0);
+    for (size_t cell = 0; output_words != 0 && cell < cells; ++cell) {
+        uint64_t * set = output_sets.data() + cell * output_words;
+        for (uint32_t a = offsets[cell]; a < offsets[cell + 1]; ++a) {
+            SymbolNumber output = arcs[a].output;
+            if (output == 0 || output >= lexicon_symbols) {
+                set[0] |= 1;
+            } else {
+                set[output / 64] |= uint64_t(1) << (output % 64);
+            }
+        }
+    }
+    index_states.clear();
+    transition_states.clear();
+    for (auto& id : ids) {
+        std::vector<uint32_t> & table = id.first >= TARGET_TABLE ?
+            transition_states : index_states;
+        TransitionTableIndex i = id.first >= TARGET_TABLE ?
+            id.first - TARGET_TABLE : id.first;
+        if (table.size() <= i) {
+            table.resize(i + 1, 0);
+        }
+        table[i] = id.second;
+    }
+    return true;
+}
+
+size_t MutatorTable::memory_size(void) const
+{
+    return (index_states.capacity() + transition_states.capacity() +
+            offsets.capacity()) * sizeof(uint32_t) +
+        arcs.capacity() * sizeof(MutatorArc) +
+        output_sets.capacity() * sizeof(uint64_t);
+}
+
 bool Transducer::initialize_input_vector(SymbolVector & input_vector,
                                          Encoder * encoder,
                                          char * line)
@@ -739,6 +1342,223 @@ Transducer::is_weighted(void)
     return header.probe_flag(Weighted);
 }
 
+bool
+Transducer::has_min_costs(void) const
+{
+    return !index_min_costs.empty();
+}
+
+bool
+Transducer::has_nonnegative_arcs(void) const
+{
+    return nonnegative_arcs;
+}
+
+Weight
+Transducer::min_cost(const TransitionTableIndex i) const
+{
+    if (i >= TARGET_TABLE) {
+        if (i - TARGET_TABLE < transition_min_costs.size()) {
+            return transition_min_costs[i - TARGET_TABLE];
+        }
+    } else if (i < index_min_costs.size()) {
+        return index_min_costs[i];
+    }
+    return 0.0;
+}
+
+void
+Transducer::count_memory(MemoryReport & report) const
+{
+    report.index_tables += indices.memory_size();
+    report.transition_tables += transitions.memory_size();
+    report.symbol_tables += alphabet.memory_size();
+    report.letter_tries += encoder.memory_size();
+    report.other += sizeof(Transducer) +
+        (index_min_costs.capacity() + transition_min_costs.capacity()) *
+        sizeof(Weight);
+}
+
+uint64_t
+Transducer::hash(uint64_t hash) const
+{
+    hash = alphabet.hash(hash);
+    hash = indices.hash(hash);
+    return transitions.hash(hash);
+}
+
+size_t MemoryReport::total(void) const
+{
+    return index_tables + transition_tables + symbol_tables + letter_tries +
+        mutator_table + symbol_sets + cache_nodes + result_caches +
+        suffix_memo + completions + case_variants + state_traces + other;
+}
+
+void MemoryReport::merge(const MemoryReport & report)
+{
+    index_tables += report.index_tables;
+    transition_tables += report.transition_tables;
+    symbol_tables += report.symbol_tables;
+    letter_tries += report.letter_tries;
+    mutator_table += report.mutator_table;
+    symbol_sets += report.symbol_sets;
+    cache_nodes += report.cache_nodes;
+    result_caches += report.result_caches;
+    suffix_memo += report.suffix_memo;
+    completions += report.completions;
+    case_variants += report.case_variants;
+    state_traces += report.state_traces;
+    other += report.other;
+}
+
+void SearchStatistics::merge(const SearchStatistics & other)
+{
+    corrections += other.corrections;
+    cache_warmed += other.cache_warmed;
+    cache_loaded += other.cache_loaded;
+    cache_built += other.cache_built;
+    cache_hits += other.cache_hits;
+    suffix_memo_hits += other.suffix_memo_hits;
+    suffix_memo_misses += other.suffix_memo_misses;
+    truncated += other.truncated;
+    sessions_resumed += other.sessions_resumed;
+    session_fallbacks += other.session_fallbacks;
+    completions_loaded += other.completions_loaded;
+    completions_searched += other.completions_searched;
+}
+
+static size_t tree_node_heap_size(const TreeNode & node)
+{
+    return node.string.capacity() * sizeof(SymbolNumber) +
+        node.flag_state.capacity() * sizeof(ValueNumber);
+}
+
+static size_t results_heap_size(const StringWeightVector & results)
+{
+    size_t bytes = results.capacity() * sizeof(StringWeightPair);
+    for (auto& result : results) {
+        bytes += string_heap_size(result.first);
+    }
+    return bytes;
+}
+
+void CacheContainer::add_node(const TreeNode & node)
+{
+    CachedNode cached;
+    cached.mutator_state = node.mutator_state;
+    cached.lexicon_state = node.lexicon_state;
+    cached.weight = node.weight;
+    cached.string_start = static_cast<uint32_t>(symbols.size());
+    cached.string_length = static_cast<uint32_t>(node.string.size());
+    symbols.insert(symbols.end(), node.string.begin(), node.string.end());
+    // The depth-first search tends to produce runs of nodes with the same
+    // flags, so only store a flag state when it changes
+    size_t state_size = node.flag_state.size();
+    if (nodes.empty() || flags.size() < state_size ||
+        !std::equal(node.flag_state.begin(), node.flag_state.end(),
+                    flags.end() - state_size)) {
+        flags.insert(flags.end(), node.flag_state.begin(),
+                     node.flag_state.end());
+    }
+    cached.flags_start = static_cast<uint32_t>(flags.size() - state_size);
+    nodes.push_back(cached);
+}
+
+void CacheContainer::restore_nodes(TreeNodeQueue & queue,
+                                   SymbolNumber state_size,
+                                   unsigned int input_state,
+                                   Weight weight) const
+{
+    queue.reserve(queue.size() + nodes.size());
+    for (auto& cached : nodes) {
+        queue.push_back(TreeNode(
+                            SymbolVector(symbols.begin() + cached.string_start,
+                                         symbols.begin() + cached.string_start +
+                                         cached.string_length),
+                            input_state, cached.mutator_state,
+                            cached.lexicon_state,
+                            FlagDiacriticState(
+                                flags.begin() + cached.flags_start,
+                                flags.begin() + cached.flags_start +
+                                state_size),
+                            cached.weight + weight));
+    }
+}
+
+size_t CacheContainer::memory_size(void) const
+{
+    return nodes.capacity() * sizeof(CachedNode) +
+        symbols.capacity() * sizeof(SymbolNumber) +
+        flags.capacity() * sizeof(ValueNumber) +
+        results_heap_size(results_len_0) + results_heap_size(results_len_1);
+}
+
+void CacheContainer::count_memory(MemoryReport & report) const
+{
+    report.cache_nodes += nodes.capacity() * sizeof(CachedNode) +
+        symbols.capacity() * sizeof(SymbolNumber) +
+        flags.capacity() * sizeof(ValueNumber);
+    report.result_caches += results_heap_size(results_len_0) +
+        results_heap_size(results_len_1);
+}
+
+MemoryReport Speller::memory_report(bool count_automata) const
+{
+    MemoryReport report;
+    if (count_automata) {
+        lexicon->count_memory(report);
+        if (mutator != NULL && mutator != lexicon) {
+            mutator->count_memory(report);
+        }
+    }
+    report.other += sizeof(Speller) +
+        cache.capacity() * sizeof(CacheContainer);
+    for (auto& entry : cache) {
+        entry.count_memory(report);
+    }
+    report.suffix_memo += suffix_memo_size;
+    for (auto* index : {&completions, &completion_memo}) {
+        for (auto& it : *index) {
+            report.completions += string_heap_size(it.first) +
+                sizeof(CompletionEntry) + MAP_NODE_OVERHEAD +
+                it.second.symbols.capacity() * sizeof(SymbolNumber) +
+                it.second.ends.capacity() * sizeof(uint32_t) +
+                it.second.weights.capacity() * sizeof(Weight);
+        }
+    }
+    if (count_automata) {
+        report.mutator_table += mutator_table->memory_size();
+    }
+    report.symbol_sets += (lexicon_symbol_bits.capacity() +
+                           lexicon_symbol_scratch.capacity()) *
+        sizeof(uint64_t) +
+        lexicon_symbol_sets.size() * (sizeof(TransitionTableIndex) +
+                                      sizeof(size_t) + 2 * sizeof(void*));
+    for (auto* variants : {&lexicon_case_variants, &mutator_case_variants}) {
+        report.case_variants += variants->capacity() * sizeof(SymbolVector);
+        for (auto& symbols : *variants) {
+            report.case_variants += symbols.capacity() * sizeof(SymbolNumber);
+        }
+    }
+    report.state_traces += (trace.lexicon.size() + trace.mutator.size()) *
+        (sizeof(TransitionTableIndex) + sizeof(unsigned long) +
+         MAP_NODE_OVERHEAD);
+    report.other += input.capacity() * sizeof(SymbolNumber) +
+        alphabet_translator.capacity() * sizeof(SymbolNumber) +
+        queue.capacity() * sizeof(TreeNode) +
+        tree_node_heap_size(next_node) +
+        nbest_queue.size() * (2 * sizeof(void*) + sizeof(Weight));
+    for (auto& node : queue) {
+        report.other += tree_node_heap_size(node);
+    }
+    return report;
+}
+
+size_t Speller::search_memory_size(void) const
+{
+    return cache_size + suffix_memo_size;
+}
+
 
 AnalysisQueue Speller::analyse(char * line, int nbest)
 {
@@ -754,6 +1574,7 @@ AnalysisQueue Speller::analyse(char * line, int nbest)
     while (queue.size() > 0) {
         next_node = queue.back();
         queue.pop_back();
+        trace_visit();
         // Final states
         if (next_node.input_state == input.size() &&
             lexicon->is_final(next_node.lexicon_state)) {
@@ -792,6 +1613,7 @@ AnalysisSymbolsQueue Speller::analyseSymbols(char * line, int nbest)
     while (queue.size() > 0) {
         next_node = queue.back();
         queue.pop_back();
+        trace_visit();
         // Final states
         if (next_node.input_state == input.size() &&
             lexicon->is_final(next_node.lexicon_state)) {
@@ -819,6 +1641,18 @@ AnalysisSymbolsQueue Speller::analyseSymbols(char * line, int nbest)
 
 void Speller::build_cache(SymbolNumber first_sym)
 {
+    // The entry only depends on the first symbol, so search it with just
+    // that as input and no limits, and leave the current search as it was
+    SymbolVector saved_input(1, first_sym);
+    if (first_sym == 0) {
+        saved_input.clear();
+    }
+    input.swap(saved_input);
+    Mode saved_mode = mode;
+    LimitingBehaviour saved_limiting = limiting;
+    Weight saved_limit = limit;
+    mode = Correct;
+    limiting = None;
     TreeNode start_node(FlagDiacriticState(get_state_size(), 0));
     queue.assign(1, start_node);
     limit = std::numeric_limits<Weight>::max();
@@ -828,6 +1662,7 @@ void Speller::build_cache(SymbolNumber first_sym)
     while (queue.size() > 0) {
         next_node = queue.back();
         queue.pop_back();
+        trace_visit();
         lexicon_epsilons();
         mutator_epsilons();
         if (mutator->is_final(next_node.mutator_state) &&
@@ -852,7 +1687,7 @@ void Speller::build_cache(SymbolNumber first_sym)
             }
         }
         if (next_node.input_state == 1) {
-            cache[first_sym].nodes.push_back(next_node);
+            cache[first_sym].add_node(next_node);
         } else {
 //            std::cerr << "discarded node\n";
         }
@@ -862,18 +1697,982 @@ void Speller::build_cache(SymbolNumber first_sym)
     }
     cache[first_sym].results_len_0.assign(corrections_len_0.begin(), corrections_len_0.end());
     cache[first_sym].results_len_1.assign(corrections_len_1.begin(), corrections_len_1.end());
+    cache[first_sym].nodes.shrink_to_fit();
+    cache[first_sym].symbols.shrink_to_fit();
+    cache[first_sym].flags.shrink_to_fit();
     cache[first_sym].empty = false;
+    cache_size += cache[first_sym].memory_size();
+    input.swap(saved_input);
+    mode = saved_mode;
+    limiting = saved_limiting;
+    limit = saved_limit;
 }
 
-CorrectionQueue Speller::correct(char * line, int nbest,
-                                 Weight maxweight, Weight beam,
-                                 float time_cutoff)
+CacheContainer & Speller::first_symbol_cache(SymbolNumber first_sym)
 {
-    mode = Correct;
-    // if input initialization fails, return empty correction queue
-    if (!init_input(line)) {
-        return CorrectionQueue();
+    if (cache[first_sym].empty) {
+        build_cache(first_sym);
+        enforce_cache_budget(first_sym);
+        ++statistics.cache_built;
+    } else {
+        ++statistics.cache_hits;
     }
+    ++cache[first_sym].hits;
+    return cache[first_sym];
+}
+
+uint64_t Speller::cache_key(void) const
+{
+    // the automata do not change, but hashing them takes a while
+    if (!automata_hashed) {
+        automata_hash = lexicon->hash(HASH_SEED);
+        if (mutator != NULL) {
+            automata_hash = mutator->hash(automata_hash);
+        }
+        automata_hashed = true;
+    }
+    uint64_t key = automata_hash;
+    if (case_folding) {
+        // the entries then hold the searches of both cases
+        key = ~key;
+    }
+    return key;
+}
+
+// Cache dumps are in host byte order; the byte order mark and the sizes
+// of the types used make sure they only get read back on a similar host.
+static const char CACHE_MAGIC[] = "HFSTOSPELLCACHE";
+static const uint32_t CACHE_VERSION = 1;
+static const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+template <typename T>
+static void dump_value(std::string & out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void dump_string(std::string & out, const std::string & str)
+{
+    dump_value<uint32_t>(out, static_cast<uint32_t>(str.size()));
+    out.append(str);
+}
+
+static void dump_results(std::string & out, const StringWeightVector & results)
+{
+    dump_value<uint32_t>(out, static_cast<uint32_t>(results.size()));
+    for (auto& result : results) {
+        dump_string(out, result.first);
+        dump_value<Weight>(out, result.second);
+    }
+}
+
+//! Bounds checked reading of a cache dump
+struct CacheReader
+{
+    const std::string & data;
+    size_t pos;
+
+    CacheReader(const std::string & d): data(d), pos(0) {}
+
+    template <typename T>
+    bool read(T & value)
+        {
+            if (data.size() - pos < sizeof(value)) {
+                return false;
+            }
+            memcpy(&value, data.data() + pos, sizeof(value));
+            pos += sizeof(value);
+            return true;
+        }
+
+    bool read(std::string & str)
+        {
+            uint32_t len = 0;
+            if (!read(len) || data.size() - pos < len) {
+                return false;
+            }
+            str.assign(data, pos, len);
+            pos += len;
+            return true;
+        }
+
+    bool read(StringWeightVector & results)
+        {
+            uint32_t count = 0;
+            if (!read(count)) {
+                return false;
+            }
+            results.clear();
+            for (uint32_t i = 0; i < count; ++i) {
+                StringWeightPair result;
+                if (!read(result.first) || !read(result.second)) {
+                    return false;
+                }
+                results.push_back(result);
+            }
+            return true;
+        }
+};
+
+std::string Speller::dump_cache(void) const
+{
+    std::string out(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    dump_value<uint32_t>(out, CACHE_VERSION);
+    dump_value<uint32_t>(out, CACHE_BYTE_ORDER);
+    dump_value<uint8_t>(out, sizeof(SymbolNumber));
+    dump_value<uint8_t>(out, sizeof(TransitionTableIndex));
+    dump_value<uint8_t>(out, sizeof(ValueNumber));
+    dump_value<uint8_t>(out, sizeof(Weight));
+    dump_value<uint64_t>(out, cache_key());
+    SymbolNumber orig_symbols = (mutator == NULL) ? 0 :
+        mutator->get_alphabet()->get_orig_symbol_count();
+    uint32_t entries = 0;
+    for (size_t sym = 0; sym < cache.size() && sym < orig_symbols; ++sym) {
+        if (!cache[sym].empty) {
+            ++entries;
+        }
+    }
+    dump_value<uint32_t>(out, entries);
+    for (size_t sym = 0; sym < cache.size() && sym < orig_symbols; ++sym) {
+        const CacheContainer & entry = cache[sym];
+        if (entry.empty) {
+            continue;
+        }
+        dump_value<SymbolNumber>(out, static_cast<SymbolNumber>(sym));
+        dump_value<uint32_t>(out, static_cast<uint32_t>(entry.nodes.size()));
+        SymbolNumber state_size = lexicon->get_state_size();
+        for (auto& node : entry.nodes) {
+            dump_value<uint32_t>(out, 1);
+            dump_value<TransitionTableIndex>(out, node.mutator_state);
+            dump_value<TransitionTableIndex>(out, node.lexicon_state);
+            dump_value<Weight>(out, node.weight);
+            dump_value<uint32_t>(out, node.string_length);
+            for (uint32_t i = 0; i < node.string_length; ++i) {
+                dump_value<SymbolNumber>(out,
+                                         entry.symbols[node.string_start + i]);
+            }
+            dump_value<uint32_t>(out, state_size);
+            for (SymbolNumber i = 0; i < state_size; ++i) {
+                dump_value<ValueNumber>(out, entry.flags[node.flags_start + i]);
+            }
+        }
+        dump_results(out, entry.results_len_0);
+        dump_results(out, entry.results_len_1);
+    }
+    return out;
+}
+
+bool Speller::load_cache(const std::string & data)
+{
+    if (mutator == NULL || data.size() < sizeof(CACHE_MAGIC) ||
+        memcmp(data.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+        return false;
+    }
+    CacheReader reader(data);
+    reader.pos = sizeof(CACHE_MAGIC);
+    uint32_t version = 0, byte_order = 0;
+    uint8_t sizes[4] = {0, 0, 0, 0};
+    uint64_t key = 0;
+    uint32_t entries = 0;
+    if (!reader.read(version) || version != CACHE_VERSION ||
+        !reader.read(byte_order) || byte_order != CACHE_BYTE_ORDER ||
+        !reader.read(sizes) ||
+        sizes[0] != sizeof(SymbolNumber) ||
+        sizes[1] != sizeof(TransitionTableIndex) ||
+        sizes[2] != sizeof(ValueNumber) || sizes[3] != sizeof(Weight) ||
+        !reader.read(key) || key != cache_key() ||
+        !reader.read(entries)) {
+        return false;
+    }
+    // Read everything before touching the cache so that a broken dump
+    // leaves it as it was
+    std::vector<std::pair<SymbolNumber, CacheContainer> > loaded;
+    SymbolNumber state_size = get_state_size();
+    for (uint32_t i = 0; i < entries; ++i) {
+        SymbolNumber sym = 0;
+        uint32_t node_count = 0;
+        if (!reader.read(sym) || sym >= cache.size() ||
+            !reader.read(node_count)) {
+            return false;
+        }
+        CacheContainer entry;
+        for (uint32_t n = 0; n < node_count; ++n) {
+            TreeNode node(FlagDiacriticState(state_size, 0));
+            uint32_t input_state = 0, string_size = 0, flag_count = 0;
+            if (!reader.read(input_state) ||
+                !reader.read(node.mutator_state) ||
+                !reader.read(node.lexicon_state) ||
+                !reader.read(node.weight) ||
+                !reader.read(string_size) ||
+                string_size > (data.size() - reader.pos) / sizeof(SymbolNumber)) {
+                return false;
+            }
+            node.input_state = input_state;
+            if (input_state != 1) {
+                return false;
+            }
+            node.string.resize(string_size);
+            for (auto& symbol : node.string) {
+                reader.read(symbol);
+            }
+            if (!reader.read(flag_count) || flag_count != state_size) {
+                return false;
+            }
+            for (auto& value : node.flag_state) {
+                if (!reader.read(value)) {
+                    return false;
+                }
+            }
+            entry.add_node(node);
+        }
+        if (!reader.read(entry.results_len_0) ||
+            !reader.read(entry.results_len_1)) {
+            return false;
+        }
+        entry.empty = false;
+        loaded.push_back(std::make_pair(sym, std::move(entry)));
+    }
+    if (reader.pos != data.size()) {
+        return false;
+    }
+    statistics.cache_loaded += loaded.size();
+    for (auto& entry : loaded) {
+        cache_size -= cache[entry.first].memory_size();
+        cache[entry.first] = std::move(entry.second);
+        cache_size += cache[entry.first].memory_size();
+    }
+    enforce_cache_budget();
+    return true;
+}
+
+void Speller::warm_cache(unsigned int threads)
+{
+    if (mutator == NULL) {
+        return;
+    }
+    std::vector<SymbolNumber> symbols;
+    for (size_t sym = 0; sym < cache.size(); ++sym) {
+        if (cache[sym].empty) {
+            symbols.push_back(static_cast<SymbolNumber>(sym));
+        }
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned int>(
+        std::min(static_cast<size_t>(threads), symbols.size()));
+    statistics.cache_warmed += symbols.size();
+    if (threads <= 1) {
+        for (auto sym : symbols) {
+            build_cache(sym);
+        }
+        enforce_cache_budget();
+        return;
+    }
+    // Each thread searches with its own clone of the speller; the automata
+    // and the error model table are only read while building the cache
+    std::atomic<size_t> next_symbol(0);
+    auto work = [&symbols, &next_symbol](Speller * worker) {
+        for (size_t i = next_symbol++; i < symbols.size(); i = next_symbol++) {
+            worker->build_cache(symbols[i]);
+        }
+    };
+    std::vector<Speller> workers;
+    workers.reserve(threads - 1);
+    for (unsigned int i = 1; i < threads; ++i) {
+        workers.emplace_back(*this, SearchClone());
+    }
+    std::vector<std::future<void> > running;
+    for (auto& worker : workers) {
+        running.push_back(std::async(std::launch::async, work, &worker));
+    }
+    work(this);
+    for (auto& result : running) {
+        result.get();
+    }
+    for (auto& worker : workers) {
+        if (tracing) {
+            trace.merge(worker.trace);
+        }
+        for (auto sym : symbols) {
+            if (!worker.cache[sym].empty) {
+                cache[sym] = std::move(worker.cache[sym]);
+                cache_size += cache[sym].memory_size();
+            }
+        }
+    }
+    enforce_cache_budget();
+}
+
+void Speller::set_suffix_memo(size_t bytes, unsigned int length)
+{
+    suffix_memo_budget = bytes;
+    suffix_memo_length = length;
+    if (bytes == 0) {
+        suffix_memo.clear();
+        suffix_memo_size = 0;
+    } else {
+        enforce_suffix_memo_budget();
+    }
+}
+
+void Speller::set_node_budget(unsigned long nodes)
+{
+    node_budget = nodes;
+}
+
+const SuffixMemoEntry & Speller::suffix_completions(void)
+{
+    // The completions depend on the states, the flags and what is left
+    // of the input, but not on how the node got there
+    std::string key;
+    key.append(reinterpret_cast<const char *>(&next_node.mutator_state),
+               sizeof(TransitionTableIndex));
+    key.append(reinterpret_cast<const char *>(&next_node.lexicon_state),
+               sizeof(TransitionTableIndex));
+    key.append(reinterpret_cast<const char *>(next_node.flag_state.data()),
+               next_node.flag_state.size() * sizeof(ValueNumber));
+    key.append(reinterpret_cast<const char *>(&input[next_node.input_state]),
+               (input.size() - next_node.input_state) * sizeof(SymbolNumber));
+    Weight bound = limit - next_node.weight;
+    auto found = suffix_memo.find(key);
+    if (found != suffix_memo.end()) {
+        if (found->second.bound >= bound) {
+            found->second.last_used = query_count;
+            ++statistics.suffix_memo_hits;
+            return found->second;
+        }
+        // searched with a tighter limit than we have now
+        suffix_memo_size -= found->second.bytes;
+        suffix_memo.erase(found);
+    }
+
+    ++statistics.suffix_memo_misses;
+    // Search from the node as correct() would, with the output and weight
+    // starting from nothing
+    TreeNodeQueue saved_queue;
+    saved_queue.swap(queue);
+    TreeNode saved_node = next_node;
+    Weight saved_limit = limit;
+    LimitingBehaviour saved_limiting = limiting;
+    limiting = MaxWeight;
+    limit = bound;
+    TreeNode start = next_node;
+    start.string.clear();
+    start.weight = 0.0;
+    queue.assign(1, start);
+    std::map<SymbolVector, Weight> best;
+    while (queue.size() > 0) {
+        if (max_time > 0.0) {
+            ++call_counter;
+            if (limit_reached ||
+                (call_counter % 1000000 == 0 &&
+                 (((double)(clock() - start_clock)) / CLOCKS_PER_SEC) > max_time)) {
+                limit_reached = true;
+                break;
+            }
+        }
+        next_node = queue.back();
+        queue.pop_back();
+        trace_visit();
+        lexicon_epsilons();
+        mutator_epsilons();
+        if (next_node.input_state == input.size()) {
+            if (mutator->is_final(next_node.mutator_state) &&
+                lexicon->is_final(next_node.lexicon_state)) {
+                Weight weight = next_node.weight +
+                    lexicon->final_weight(next_node.lexicon_state) +
+                    mutator->final_weight(next_node.mutator_state);
+                if (weight <= limit && (best.count(next_node.string) == 0 ||
+                                        best[next_node.string] > weight)) {
+                    best[next_node.string] = weight;
+                }
+            }
+        } else {
+            consume_input();
+        }
+    }
+    queue.swap(saved_queue);
+    next_node = saved_node;
+    limit = saved_limit;
+    limiting = saved_limiting;
+    if (limit_reached) {
+        // the completions found so far are not all there are, so they are
+        // not kept; correct() stops at its next node
+        static const SuffixMemoEntry none = SuffixMemoEntry();
+        return none;
+    }
+
+    SuffixMemoEntry entry;
+    entry.completions.assign(best.begin(), best.end());
+    entry.bound = bound;
+    entry.last_used = query_count;
+    entry.bytes = key.size() + sizeof(SuffixMemoEntry) + MAP_NODE_OVERHEAD +
+        entry.completions.capacity() * sizeof(entry.completions[0]);
+    for (auto& completion : entry.completions) {
+        entry.bytes += completion.first.capacity() * sizeof(SymbolNumber);
+    }
+    suffix_memo_size += entry.bytes;
+    return suffix_memo[key] = std::move(entry);
+}
+
+void Speller::enforce_suffix_memo_budget(void)
+{
+    if (suffix_memo_budget == 0 || suffix_memo_size <= suffix_memo_budget) {
+        return;
+    }
+    // Drop the oldest entries down to three quarters of the budget, so
+    // that this is not done again on every query
+    std::vector<std::pair<unsigned long, const std::string *> > ages;
+    for (auto& entry : suffix_memo) {
+        ages.push_back(std::make_pair(entry.second.last_used, &entry.first));
+    }
+    std::sort(ages.begin(), ages.end());
+    std::vector<std::string> victims;
+    size_t size = suffix_memo_size;
+    for (auto& age : ages) {
+        if (size <= suffix_memo_budget / 4 * 3) {
+            break;
+        }
+        size -= suffix_memo.at(*age.second).bytes;
+        victims.push_back(*age.second);
+    }
+    for (auto& victim : victims) {
+        suffix_memo.erase(victim);
+    }
+    suffix_memo_size = size;
+}
+
+void Speller::lexicon_successors(const TreeNode & node,
+                                 TreeNodeQueue & successors)
+{
+    TransitionTableIndex state = node.lexicon_state;
+    if (lexicon->has_epsilons_or_flags(state + 1)) {
+        TransitionTableIndex next = lexicon->next(state, 0);
+        STransition i_s = lexicon->take_epsilons_and_flags(next);
+        while (i_s.symbol != NO_SYMBOL) {
+            SymbolNumber flag = lexicon->transitions.input_symbol(next);
+            if (flag == 0) {
+                successors.push_back(node.update_lexicon(i_s.symbol,
+                                                         i_s.index,
+                                                         i_s.weight));
+            } else {
+                TreeNode flagged = node;
+                if (flagged.try_compatible_with(operations->at(flag))) {
+                    successors.push_back(flagged.update_lexicon(0,
+                                                                i_s.index,
+                                                                i_s.weight));
+                }
+            }
+            ++next;
+            i_s = lexicon->take_epsilons_and_flags(next);
+        }
+    }
+    // The symbols added for unknown input cannot be in any word
+    SymbolNumber symbols = lexicon->get_alphabet()->get_orig_symbol_count();
+    for (SymbolNumber sym = 1; sym < symbols; ++sym) {
+        if (sym == lexicon->get_unknown() || sym == lexicon->get_identity() ||
+            lexicon->is_flag(sym) || !lexicon->has_transitions(state + 1, sym)) {
+            continue;
+        }
+        TransitionTableIndex next = lexicon->next(state, sym);
+        STransition i_s = lexicon->take_non_epsilons(next, sym);
+        while (i_s.symbol != NO_SYMBOL) {
+            successors.push_back(node.update_lexicon(i_s.symbol, i_s.index,
+                                                     i_s.weight));
+            ++next;
+            i_s = lexicon->take_non_epsilons(next, sym);
+        }
+    }
+}
+
+//! the lexicon state and flags a completion index entry is kept under
+static std::string completion_key(const TreeNode & node)
+{
+    std::string key;
+    key.append(reinterpret_cast<const char *>(&node.lexicon_state),
+               sizeof(TransitionTableIndex));
+    key.append(reinterpret_cast<const char *>(node.flag_state.data()),
+               node.flag_state.size() * sizeof(ValueNumber));
+    return key;
+}
+
+//! @brief A node of the search for completions, cheapest first.
+struct CompletionCandidate
+{
+    Weight estimate; //!< weight so far and least weight to a final state
+    bool final; //!< whether the node ends a completion here
+    TreeNode node; //!< the node, with the completion as its output
+};
+
+struct CompletionCandidateComparison
+{
+    bool operator()(const CompletionCandidate & lhs,
+                    const CompletionCandidate & rhs) const
+        {
+            // shorter first among equals, so that a word comes before the
+            // longer words it starts
+            if (lhs.estimate != rhs.estimate) {
+                return lhs.estimate > rhs.estimate;
+            }
+            return lhs.node.string.size() > rhs.node.string.size();
+        }
+};
+
+const CompletionEntry & Speller::state_completions(const TreeNode & node)
+{
+    std::string key = completion_key(node);
+    auto found = completions.find(key);
+    if (found != completions.end()) {
+        return found->second;
+    }
+    found = completion_memo.find(key);
+    if (found != completion_memo.end()) {
+        return found->second;
+    }
+    // the states typed lately are what the next words need
+    if (completion_memo.size() >= COMPLETION_MEMO_MAX_STATES) {
+        completion_memo.clear();
+    }
+    return completion_memo[key] = search_completions(node);
+}
+
+CompletionEntry Speller::search_completions(const TreeNode & node)
+{
+    ++statistics.completions_searched;
+    // A best-first search from the node, with the least cost to a final
+    // state as the estimate of the rest if the lexicon has them, so that
+    // the completions come out cheapest first
+    std::priority_queue<CompletionCandidate,
+                        std::vector<CompletionCandidate>,
+                        CompletionCandidateComparison> candidates;
+    TreeNode start = node;
+    start.string.clear();
+    start.weight = 0.0;
+    candidates.push(CompletionCandidate{lexicon->min_cost(start.lexicon_state),
+                                        false, start});
+    std::set<SymbolVector> seen;
+    CompletionEntry entry;
+    TreeNodeQueue successors;
+    unsigned long expanded = 0;
+    while (!candidates.empty() && entry.size() < completion_count &&
+           expanded < COMPLETION_MAX_NODES) {
+        CompletionCandidate candidate = candidates.top();
+        candidates.pop();
+        const TreeNode & current = candidate.node;
+        if (candidate.final) {
+            if (seen.insert(current.string).second) {
+                entry.symbols.insert(entry.symbols.end(),
+                                     current.string.begin(),
+                                     current.string.end());
+                entry.ends.push_back(entry.symbols.size());
+                entry.weights.push_back(current.weight);
+            }
+            continue;
+        }
+        ++expanded;
+        if (lexicon->is_final(current.lexicon_state)) {
+            TreeNode ending = current;
+            ending.weight += lexicon->final_weight(current.lexicon_state);
+            candidates.push(CompletionCandidate{ending.weight, true, ending});
+        }
+        if (current.string.size() >= COMPLETION_MAX_LENGTH) {
+            continue;
+        }
+        successors.clear();
+        lexicon_successors(current, successors);
+        for (auto& next : successors) {
+            Weight estimate = next.weight +
+                lexicon->min_cost(next.lexicon_state);
+            candidates.push(CompletionCandidate{estimate, false, next});
+        }
+    }
+    return entry;
+}
+
+CorrectionQueue Speller::complete(char * line, int nbest, Weight maxweight)
+{
+    mode = Check;
+    CorrectionQueue results;
+    if (!init_input(line)) {
+        return results;
+    }
+    // Walk the lexicon along the prefix as check() does, stopping at the
+    // nodes that have read all of it
+    TreeNode start_node(FlagDiacriticState(get_state_size(), 0));
+    queue.assign(1, start_node);
+    limit = std::numeric_limits<Weight>::max();
+    TreeNodeQueue prefix_nodes;
+    while (queue.size() > 0) {
+        next_node = queue.back();
+        queue.pop_back();
+        trace_visit();
+        if (next_node.input_state == input.size()) {
+            prefix_nodes.push_back(next_node);
+            continue;
+        }
+        lexicon_epsilons();
+        lexicon_consume();
+    }
+    std::map<std::string, Weight> found;
+    for (auto& node : prefix_nodes) {
+        const CompletionEntry & entry = state_completions(node);
+        std::string prefix = stringify(lexicon->get_key_table(), node.string);
+        uint32_t begin = 0;
+        for (size_t i = 0; i < entry.size(); ++i) {
+            SymbolVector rest(entry.symbols.begin() + begin,
+                              entry.symbols.begin() + entry.ends[i]);
+            begin = entry.ends[i];
+            Weight weight = node.weight + entry.weights[i];
+            if (maxweight >= 0.0 && weight > maxweight) {
+                break;
+            }
+            std::string word = prefix + stringify(lexicon->get_key_table(),
+                                                  rest);
+            if (found.count(word) == 0 || found[word] > weight) {
+                found[word] = weight;
+            }
+        }
+    }
+    std::vector<StringWeightPair> best(found.begin(), found.end());
+    std::stable_sort(best.begin(), best.end(),
+                     [](const StringWeightPair & a, const StringWeightPair & b)
+                     { return a.second < b.second; });
+    size_t count = (nbest > 0) ? static_cast<size_t>(nbest) : completion_count;
+    if (best.size() > count) {
+        best.resize(count);
+    }
+    for (auto& result : best) {
+        results.push(result);
+    }
+    return results;
+}
+
+void Speller::set_completion_count(unsigned int count)
+{
+    if (count == completion_count) {
+        return;
+    }
+    completion_count = count;
+    completions.clear();
+    completion_memo.clear();
+}
+
+void Speller::build_completions(unsigned int depth)
+{
+    // Breadth first over the prefixes, each state and flags once; epsilon
+    // arcs do not make the prefix longer
+    TreeNodeQueue level(1, TreeNode(FlagDiacriticState(get_state_size(), 0)));
+    std::set<std::string> visited;
+    TreeNodeQueue successors;
+    for (unsigned int length = 0; length <= depth && !level.empty();
+         ++length) {
+        TreeNodeQueue next_level;
+        while (!level.empty()) {
+            TreeNode node = level.back();
+            level.pop_back();
+            node.string.clear();
+            node.weight = 0.0;
+            std::string key = completion_key(node);
+            if (!visited.insert(key).second) {
+                continue;
+            }
+            if (completions.count(key) == 0) {
+                completions[key] = search_completions(node);
+            }
+            successors.clear();
+            lexicon_successors(node, successors);
+            for (auto& next : successors) {
+                if (next.string.empty()) {
+                    level.push_back(next);
+                } else if (length < depth) {
+                    next_level.push_back(next);
+                }
+            }
+        }
+        level.swap(next_level);
+    }
+}
+
+// Completion index dumps are checked like cache dumps, against the lexicon
+// only
+static const char COMPLETION_MAGIC[] = "HFSTOSPELLCOMPL";
+static const uint32_t COMPLETION_VERSION = 1;
+
+std::string Speller::dump_completions(void) const
+{
+    std::string out(COMPLETION_MAGIC, sizeof(COMPLETION_MAGIC));
+    dump_value<uint32_t>(out, COMPLETION_VERSION);
+    dump_value<uint32_t>(out, CACHE_BYTE_ORDER);
+    dump_value<uint8_t>(out, sizeof(SymbolNumber));
+    dump_value<uint8_t>(out, sizeof(TransitionTableIndex));
+    dump_value<uint8_t>(out, sizeof(ValueNumber));
+    dump_value<uint8_t>(out, sizeof(Weight));
+    dump_value<uint64_t>(out, lexicon->hash(HASH_SEED));
+    dump_value<uint32_t>(out, completion_count);
+    dump_value<uint32_t>(out, static_cast<uint32_t>(completions.size()));
+    for (auto& it : completions) {
+        const CompletionEntry & entry = it.second;
+        dump_string(out, it.first);
+        dump_value<uint32_t>(out, static_cast<uint32_t>(entry.size()));
+        for (size_t i = 0; i < entry.size(); ++i) {
+            dump_value<uint32_t>(out, entry.ends[i]);
+            dump_value<Weight>(out, entry.weights[i]);
+        }
+        for (auto symbol : entry.symbols) {
+            dump_value<SymbolNumber>(out, symbol);
+        }
+    }
+    return out;
+}
+
+bool Speller::load_completions(const std::string & data)
+{
+    if (data.size() < sizeof(COMPLETION_MAGIC) ||
+        memcmp(data.data(), COMPLETION_MAGIC, sizeof(COMPLETION_MAGIC)) != 0) {
+        return false;
+    }
+    CacheReader reader(data);
+    reader.pos = sizeof(COMPLETION_MAGIC);
+    uint32_t version = 0, byte_order = 0, count = 0, entries = 0;
+    uint8_t sizes[4] = {0, 0, 0, 0};
+    uint64_t key = 0;
+    if (!reader.read(version) || version != COMPLETION_VERSION ||
+        !reader.read(byte_order) || byte_order != CACHE_BYTE_ORDER ||
+        !reader.read(sizes) ||
+        sizes[0] != sizeof(SymbolNumber) ||
+        sizes[1] != sizeof(TransitionTableIndex) ||
+        sizes[2] != sizeof(ValueNumber) || sizes[3] != sizeof(Weight) ||
+        !reader.read(key) || key != lexicon->hash(HASH_SEED) ||
+        !reader.read(count) || count == 0 || !reader.read(entries)) {
+        return false;
+    }
+    size_t key_size = sizeof(TransitionTableIndex) +
+        get_state_size() * sizeof(ValueNumber);
+    std::unordered_map<std::string, CompletionEntry> loaded;
+    for (uint32_t i = 0; i < entries; ++i) {
+        std::string state;
+        uint32_t size = 0;
+        if (!reader.read(state) || state.size() != key_size ||
+            !reader.read(size) || size > count) {
+            return false;
+        }
+        CompletionEntry entry;
+        entry.ends.resize(size);
+        entry.weights.resize(size);
+        uint32_t last_end = 0;
+        for (uint32_t c = 0; c < size; ++c) {
+            if (!reader.read(entry.ends[c]) || entry.ends[c] < last_end ||
+                !reader.read(entry.weights[c])) {
+                return false;
+            }
+            last_end = entry.ends[c];
+        }
+        if (last_end > (data.size() - reader.pos) / sizeof(SymbolNumber)) {
+            return false;
+        }
+        entry.symbols.resize(last_end);
+        for (auto& symbol : entry.symbols) {
+            reader.read(symbol);
+        }
+        loaded[state] = std::move(entry);
+    }
+    if (reader.pos != data.size()) {
+        return false;
+    }
+    completion_count = count;
+    completions.swap(loaded);
+    completion_memo.clear();
+    statistics.completions_loaded += completions.size();
+    return true;
+}
+
+void Speller::set_case_folding(bool on)
+{
+    if (on == case_folding) {
+        return;
+    }
+    case_folding = on;
+    // what was searched with the other setting would be wrong now
+    for (auto& entry : cache) {
+        entry = CacheContainer();
+    }
+    cache_size = 0;
+    suffix_memo.clear();
+    suffix_memo_size = 0;
+    if (on) {
+        add_case_variants(lexicon, lexicon_case_variants);
+        if (mutator != NULL) {
+            add_case_variants(mutator, mutator_case_variants);
+        }
+    }
+}
+
+void Speller::add_case_variants(Transducer * transducer,
+                                std::vector<SymbolVector> & variants)
+{
+    KeyTable * keys = transducer->get_key_table();
+    TransducerAlphabet * alphabet = transducer->get_alphabet();
+    while (variants.size() < keys->size()) {
+        SymbolVector others;
+        const char * symbol = keys->at(variants.size()).c_str();
+        unsigned int c = next_code_point(symbol);
+        // only symbols of one letter have another case
+        if (c != 0 && *symbol == '\0') {
+            for (unsigned int other : {lower_case(c), upper_case(c)}) {
+                std::string other_string;
+                append_code_point(other_string, other);
+                if (other != c && alphabet->has_string(other_string)) {
+                    others.push_back(
+                        alphabet->get_string_to_symbol()->at(other_string));
+                }
+            }
+        }
+        variants.push_back(others);
+    }
+}
+
+void Speller::set_tracing(bool on)
+{
+    tracing = on;
+}
+
+void Speller::trace_visit(void)
+{
+    if (!tracing) {
+        return;
+    }
+    ++trace.lexicon[next_node.lexicon_state];
+    if (mutator != NULL && mode == Correct) {
+        ++trace.mutator[next_node.mutator_state];
+    }
+}
+
+void StateTrace::merge(const StateTrace & other)
+{
+    for (auto& visits : other.lexicon) {
+        lexicon[visits.first] += visits.second;
+    }
+    for (auto& visits : other.mutator) {
+        mutator[visits.first] += visits.second;
+    }
+}
+
+std::string StateTrace::dump(void) const
+{
+    std::ostringstream out;
+    for (auto& visits : lexicon) {
+        out << "lexicon\t" << visits.first << "\t" << visits.second << "\n";
+    }
+    for (auto& visits : mutator) {
+        out << "mutator\t" << visits.first << "\t" << visits.second << "\n";
+    }
+    return out.str();
+}
+
+bool StateTrace::load(const std::string & data)
+{
+    std::istringstream in(data);
+    std::string automaton;
+    TransitionTableIndex state;
+    unsigned long count;
+    while (in >> automaton >> state >> count) {
+        if (automaton == "lexicon") {
+            lexicon[state] += count;
+        } else if (automaton == "mutator") {
+            mutator[state] += count;
+        } else {
+            return false;
+        }
+    }
+    return in.eof();
+}
+
+void Speller::set_cache_budget(size_t bytes)
+{
+    cache_budget = bytes;
+    enforce_cache_budget();
+}
+
+void Speller::enforce_cache_budget(SymbolNumber keep)
+{
+    while (cache_budget > 0 && cache_size > cache_budget) {
+        size_t victim = cache.size();
+        for (size_t sym = 0; sym < cache.size(); ++sym) {
+            if (!cache[sym].empty && sym != keep &&
+                (victim == cache.size() ||
+                 cache[sym].hits < cache[victim].hits)) {
+                victim = sym;
+            }
+        }
+        if (victim == cache.size()) {
+            return; // only the entry in use is left
+        }
+        cache_size -= cache[victim].memory_size();
+        cache[victim].clear();
+        cache[victim].hits = 0;
+        // age the counts so that entries popular long ago can go too
+        for (auto& entry : cache) {
+            entry.hits /= 2;
+        }
+    }
+}
+
+CorrectionQueue Speller::correct(char * line, int nbest,
+                                 Weight maxweight, Weight beam,
+                                 float time_cutoff)
+{
+    std::vector<CorrectionQueue> corrections =
+        correct(std::vector<char *>(1, line), std::vector<Weight>(1, 0.0),
+                nbest, maxweight, beam, time_cutoff);
+    return std::move(corrections[0]);
+}
+
+std::vector<CorrectionQueue> Speller::correct(
+    const std::vector<char *> & lines, const std::vector<Weight> & offsets,
+    int nbest, Weight maxweight, Weight beam, float time_cutoff)
+{
+    mode = Correct;
+    truncated = false;
+    size_t variants = lines.size();
+    // The queues for our suggestions, one per line
+    std::vector<CorrectionQueue> correction_queues(variants);
+    // The input of all the lines is searched one after the other, each
+    // node staying within the span of its own line
+    std::vector<unsigned int> starts(variants, 0);
+    std::vector<unsigned int> ends(variants, 0);
+    std::vector<char> tokenized(variants, 0);
+    // which line each input position after its start belongs to, if
+    // there are several
+    std::vector<unsigned int> owners;
+    if (variants == 1) {
+        // if input initialization fails, return empty correction queue
+        if (!init_input(lines[0])) {
+            return correction_queues;
+        }
+        tokenized[0] = 1;
+        ends[0] = input.size();
+    } else {
+        SymbolVector all_input;
+        for (size_t v = 0; v < variants; ++v) {
+            if (!init_input(lines[v])) {
+                continue;
+            }
+            tokenized[v] = 1;
+            starts[v] = all_input.size();
+            all_input.insert(all_input.end(), input.begin(), input.end());
+            ends[v] = all_input.size();
+        }
+        input.swap(all_input);
+        owners.assign(input.size() + 1, 0);
+        for (size_t v = 0; v < variants; ++v) {
+            for (unsigned int i = starts[v] + 1; tokenized[v] && i <= ends[v];
+                 ++i) {
+                owners[i] = v;
+            }
+        }
+    }
+    unsigned long expanded = 0;
     max_time = 0.0;
     if (time_cutoff > 0.0) {
         max_time = time_cutoff;
@@ -881,17 +2680,54 @@ CorrectionQueue Speller::correct(char * line, int nbest,
         call_counter = 0;
         limit_reached = false;
     }
-    set_limiting_behaviour(nbest, maxweight, beam);
+    // the maximum weight is for a correction before the offset of its
+    // line, so the search goes as far as the line with the most offset
+    Weight search_maxweight = maxweight;
+    if (maxweight >= 0.0) {
+        for (size_t v = 0; v < variants; ++v) {
+            search_maxweight = std::max(search_maxweight,
+                                        maxweight + offsets[v]);
+        }
+    }
+    set_limiting_behaviour(nbest, search_maxweight, beam);
     nbest_queue = WeightQueue();
-    // The queue for our suggestions
-    CorrectionQueue correction_queue;
-    // A placeholding map, only one weight per correction
-    std::map<std::string, Weight> corrections;
-    SymbolNumber first_input = (input.size() == 0) ? 0 : input[0];
-    if (cache[first_input].empty) {
-        build_cache(first_input); // XXX: cache corrupts limit!
+    ++query_count;
+    ++statistics.corrections;
+    // A placeholding map per line, only one weight per correction
+    std::vector<std::map<std::string, Weight> > corrections(variants);
+    // with case folding, corrections are written the way each line is
+    std::vector<Capitalization> capitals(variants, NoCapitals);
+    if (case_folding) {
+        for (size_t v = 0; v < variants; ++v) {
+            capitals[v] = capitalization(lines[v]);
+        }
     }
-    if (input.size() <= 1) {
+    auto add_correction = [&](size_t variant, const std::string & found_string,
+                              Weight weight) {
+        if (maxweight >= 0.0 && weight - offsets[variant] > maxweight) {
+            return;
+        }
+        const std::string & string = (capitals[variant] == NoCapitals) ?
+            found_string : capitalize(found_string, capitals[variant]);
+        /* if the correction is novel or better than before, insert it
+         */
+        std::map<std::string, Weight> & found = corrections[variant];
+        if (found.count(string) == 0 ||
+            found[string] > weight) {
+            found[string] = weight;
+            best_suggestion = std::min(best_suggestion, weight);
+            if (nbest > 0) {
+                nbest_queue.push(weight);
+                if (nbest_queue.size() > nbest) {
+                    nbest_queue.pop();
+                }
+            }
+        }
+    };
+    if (variants == 1 && input.size() <= 1 && !case_folding) {
+        SymbolNumber first_input = (input.size() == 0) ? 0 : input[0];
+        first_symbol_cache(first_input);
+        CorrectionQueue & correction_queue = correction_queues[0];
         // get the cached results and we're done
         StringWeightVector * results;
         if (input.size() == 0) {
@@ -923,11 +2759,32 @@ CorrectionQueue Speller::correct(char * line, int nbest,
                 }
             }
         }
-        return correction_queue;
-    } else {
-        // populate the tree node queue
-        queue.assign(cache[first_input].nodes.begin(), cache[first_input].nodes.end());
+        return correction_queues;
     }
+    // populate the tree node queue from the first symbol of each line,
+    // the first line last so that it is searched first
+    TreeNodeQueue frontier;
+    for (size_t v = variants; v-- > 0; ) {
+        if (!tokenized[v]) {
+            continue;
+        }
+        unsigned int length = ends[v] - starts[v];
+        SymbolNumber first_input = (length == 0) ? 0 : input[starts[v]];
+        first_symbol_cache(first_input);
+        if (length == 0) {
+            for (auto& it : cache[first_input].results_len_0) {
+                add_correction(v, it.first, it.second + offsets[v]);
+            }
+        } else if (length == 1) {
+            for (auto& it : cache[first_input].results_len_1) {
+                add_correction(v, it.first, it.second + offsets[v]);
+            }
+        } else {
+            cache[first_input].restore_nodes(frontier, get_state_size(),
+                                             starts[v] + 1, offsets[v]);
+        }
+    }
+    queue.swap(frontier);
     // TreeNode start_node(FlagDiacriticState(get_state_size(), 0));
     // queue.assign(1, start_node);
 
@@ -939,27 +2796,66 @@ CorrectionQueue Speller::correct(char * line, int nbest,
                 (call_counter % 1000000 == 0 &&
                  (((double)(clock() - start_clock)) / CLOCKS_PER_SEC) > max_time)) {
                 limit_reached = true;
+                truncated = true;
                 break;
             }
         }
+        // Or expanded as many nodes as we may?
+        if (node_budget > 0 && expanded++ >= node_budget) {
+            truncated = true;
+            break;
+        }
         /*
           For depth-first searching, we save the back node now, remove it
           from the queue and add new nodes to the search at the back.
         */
         next_node = queue.back();
         queue.pop_back();
-        set_limiting_behaviour(nbest, maxweight, beam); // XXX: need to reset
+        trace_visit();
+        set_limiting_behaviour(nbest, search_maxweight, beam); // XXX: need to reset
         adjust_weight_limits(nbest, beam);
         // if we can't get an acceptable result, never mind
         if (next_node.weight > limit) {
             continue;
         }
-        if (next_node.input_state > 1) {
+        size_t variant = owners.empty() ? 0 : owners[next_node.input_state];
+        if (maxweight >= 0.0 &&
+            next_node.weight - offsets[variant] > maxweight) {
+            continue;
+        }
+        unsigned int input_end = ends[variant];
+        // With a node budget the results must not depend on the words
+        // corrected before, so the memo is left alone; without a weight
+        // limit yet, an entry would hold every completion of the rest
+        if (suffix_memo_budget > 0 && node_budget == 0 && variants == 1 &&
+            limit < std::numeric_limits<Weight>::max() &&
+            next_node.input_state > 1 &&
+            next_node.input_state < input.size() &&
+            input.size() - next_node.input_state <= suffix_memo_length) {
+            // splice in the completions of the rest of the input instead of
+            // searching them again
+            SymbolVector prefix = next_node.string;
+            Weight prefix_weight = next_node.weight;
+            const SuffixMemoEntry & memo = suffix_completions();
+            for (auto& completion : memo.completions) {
+                Weight weight = prefix_weight + completion.second;
+                if (weight > limit) {
+                    continue;
+                }
+                SymbolVector full(prefix);
+                full.insert(full.end(), completion.first.begin(),
+                            completion.first.end());
+                add_correction(0, stringify(lexicon->get_key_table(), full),
+                               weight);
+            }
+            continue;
+        }
+        if (next_node.input_state > starts[variant] + 1) {
             // Early epsilons were handled during the caching stage
             lexicon_epsilons();
             mutator_epsilons();
         }
-        if (next_node.input_state == input.size()) {
+        if (next_node.input_state == input_end) {
             /* if our transducers are in final states
              * we generate the correction
              */
@@ -975,43 +2871,239 @@ CorrectionQueue Speller::correct(char * line, int nbest,
                 if (weight > limit) {
                     continue;
                 }
-                std::string string = stringify(lexicon->get_key_table(), next_node.string);
-                /* if the correction is novel or better than before, insert it
-                 */
-                if (corrections.count(string) == 0 ||
-                    corrections[string] > weight) {
-                    corrections[string] = weight;
-                    best_suggestion = std::min(best_suggestion, weight);
-                    if (nbest > 0) {
-                        nbest_queue.push(weight);
-                        if (nbest_queue.size() > nbest) {
-                            nbest_queue.pop();
-                        }
-                    }
-                }
+                add_correction(variant,
+                               stringify(lexicon->get_key_table(),
+                                         next_node.string),
+                               weight);
             }
         } else {
             consume_input();
         }
     }
+    enforce_suffix_memo_budget();
     adjust_weight_limits(nbest, beam);
+    if (truncated) {
+        ++statistics.truncated;
+    }
 
-    for (auto& it : corrections) {
-        if (it.second <= limit && // we're not over our weight limit and
-            (nbest == 0 || // we either don't have an nbest condition or
-             (it.second <= nbest_queue.get_highest() && // we're below the worst nbest weight and
-              correction_queue.size() < nbest &&
-              nbest_queue.size() > 0))) { // number of results
-            correction_queue.push(StringWeightPair(it.first, it.second));
-            if (nbest != 0) {
-                nbest_queue.pop();
+    if (variants == 1) {
+        CorrectionQueue & correction_queue = correction_queues[0];
+        for (auto& it : corrections[0]) {
+            if (it.second <= limit && // we're not over our weight limit and
+                (nbest == 0 || // we either don't have an nbest condition or
+                 (it.second <= nbest_queue.get_highest() && // we're below the worst nbest weight and
+                  correction_queue.size() < nbest &&
+                  nbest_queue.size() > 0))) { // number of results
+                correction_queue.push(StringWeightPair(it.first, it.second));
+                if (nbest != 0) {
+                    nbest_queue.pop();
+                }
             }
         }
+        return correction_queues;
+    }
+    // the best corrections of all the lines, whichever line they are for
+    typedef std::pair<Weight, std::pair<size_t, const std::string *> >
+        LineCorrection;
+    std::vector<LineCorrection> best;
+    for (size_t v = 0; v < variants; ++v) {
+        for (auto& it : corrections[v]) {
+            if (it.second <= limit) {
+                best.push_back(LineCorrection(
+                                   it.second, std::make_pair(v, &it.first)));
+            }
+        }
+    }
+    // ties keep the order of the lines and then of the strings
+    std::stable_sort(best.begin(), best.end(),
+                     [](const LineCorrection & a, const LineCorrection & b)
+                     { return a.first < b.first; });
+    if (nbest > 0 && best.size() > (size_t)nbest) {
+        best.resize(nbest);
+    }
+    for (auto& it : best) {
+        correction_queues[it.second.first].push(
+            StringWeightPair(*it.second.second, it.first));
+    }
+    return correction_queues;
+}
+
+CorrectionQueue Speller::correct(CorrectionSession & session, char * line,
+                                 int nbest, Weight maxweight, Weight beam)
+{
+    mode = Correct;
+    truncated = false;
+    CorrectionQueue correction_queue;
+    if (mutator == NULL) {
+        return correction_queue;
+    }
+    if (maxweight < 0.0) {
+        // every node would have to be kept, so nothing is gained
+        session = CorrectionSession();
+        ++statistics.session_fallbacks;
+        return correct(line, nbest, maxweight, beam);
+    }
+    Weight bound = maxweight;
+    uint64_t key = cache_key();
+    if (session.key != key || session.bound != bound) {
+        session = CorrectionSession();
+        session.key = key;
+        session.bound = bound;
+    }
+    if (!init_input(line)) {
+        session.input.clear();
+        session.frontiers.clear();
+        return correction_queue;
+    }
+    // keep the frontiers of the input the two lines start with
+    size_t common = 0;
+    while (common < input.size() && common < session.input.size() &&
+           input[common] == session.input[common]) {
+        ++common;
+    }
+    if (session.frontiers.size() > common + 1) {
+        session.frontiers.resize(common + 1);
+    }
+    if (session.frontiers.size() > 1) {
+        ++statistics.sessions_resumed;
+    }
+    session.input = input;
+    limiting = MaxWeight;
+    limit = bound;
+    while (session.frontiers.size() < input.size() + 1) {
+        // with too many nodes to keep, or the node budget spent before the
+        // end of the input, the search from scratch gives what it finds
+        // within the budget instead
+        if (!extend_session(session)) {
+            session = CorrectionSession();
+            ++statistics.session_fallbacks;
+            return correct(line, nbest, maxweight, beam);
+        }
+    }
+    ++query_count;
+    ++statistics.corrections;
+    std::map<std::string, Weight> corrections;
+    Capitalization capitals = case_folding ? capitalization(line) : NoCapitals;
+    for (auto& node : session.frontiers.back()) {
+        if (!mutator->is_final(node.mutator_state) ||
+            !lexicon->is_final(node.lexicon_state)) {
+            continue;
+        }
+        Weight weight = node.weight +
+            lexicon->final_weight(node.lexicon_state) +
+            mutator->final_weight(node.mutator_state);
+        if (weight > limit) {
+            continue;
+        }
+        std::string string = stringify(lexicon->get_key_table(), node.string);
+        if (capitals != NoCapitals) {
+            string = capitalize(string, capitals);
+        }
+        auto found = corrections.find(string);
+        if (found == corrections.end()) {
+            corrections[string] = weight;
+        } else if (found->second > weight) {
+            found->second = weight;
+        }
+    }
+    std::vector<StringWeightPair> best(corrections.begin(), corrections.end());
+    std::stable_sort(best.begin(), best.end(),
+                     [](const StringWeightPair & a, const StringWeightPair & b)
+                     { return a.second < b.second; });
+    for (size_t i = 0; i < best.size(); ++i) {
+        if ((nbest > 0 && i >= (size_t)nbest) ||
+            (beam >= 0.0 && best[i].second > best[0].second + beam)) {
+            break;
+        }
+        correction_queue.push(best[i]);
     }
-    //cache[first_input].clear();
     return correction_queue;
 }
 
+// What a search node goes on to find depends on its states, flags and
+// output, and on what is left of the input, which is the same for all the
+// nodes of one frontier
+static std::string session_node_key(const TreeNode & node)
+{
+    std::string key;
+    key.append(reinterpret_cast<const char *>(&node.mutator_state),
+               sizeof(TransitionTableIndex));
+    key.append(reinterpret_cast<const char *>(&node.lexicon_state),
+               sizeof(TransitionTableIndex));
+    key.append(reinterpret_cast<const char *>(node.flag_state.data()),
+               node.flag_state.size() * sizeof(ValueNumber));
+    key.append(reinterpret_cast<const char *>(node.string.data()),
+               node.string.size() * sizeof(SymbolNumber));
+    return key;
+}
+
+bool Speller::extend_session(CorrectionSession & session)
+{
+    size_t length = session.frontiers.size();
+    size_t kept = 0;
+    for (auto& kept_frontier : session.frontiers) {
+        kept += kept_frontier.size();
+    }
+    TreeNodeQueue frontier;
+    if (length == 1) {
+        // the nodes after the first symbol are what the cache keeps
+        SymbolNumber first_input = input[0];
+        first_symbol_cache(first_input);
+        cache[first_input].restore_nodes(frontier, get_state_size());
+        frontier.erase(std::remove_if(frontier.begin(), frontier.end(),
+                                      [this](const TreeNode & node)
+                                      { return node.weight > limit; }),
+                       frontier.end());
+        if (kept + frontier.size() > SESSION_MAX_NODES) {
+            return false;
+        }
+        session.frontiers.push_back(std::move(frontier));
+        return true;
+    }
+    if (length == 0) {
+        queue.assign(1, TreeNode(FlagDiacriticState(get_state_size(), 0)));
+    } else {
+        queue.clear();
+        for (auto& node : session.frontiers.back()) {
+            next_node = node;
+            consume_input();
+        }
+    }
+    // close the nodes that have read one more symbol under epsilons,
+    // expanding only the lightest of nodes alike
+    std::unordered_map<std::string, size_t> found;
+    unsigned long expanded = 0;
+    while (queue.size() > 0) {
+        if (node_budget > 0 && expanded++ >= node_budget) {
+            return false;
+        }
+        next_node = queue.back();
+        queue.pop_back();
+        trace_visit();
+        if (next_node.weight > limit) {
+            continue;
+        }
+        auto alike = found.emplace(session_node_key(next_node),
+                                   frontier.size());
+        if (!alike.second) {
+            TreeNode & before = frontier[alike.first->second];
+            if (before.weight <= next_node.weight) {
+                continue;
+            }
+            before = next_node;
+        } else {
+            if (kept + frontier.size() >= SESSION_MAX_NODES) {
+                return false;
+            }
+            frontier.push_back(next_node);
+        }
+        lexicon_epsilons();
+        mutator_epsilons();
+    }
+    session.frontiers.push_back(std::move(frontier));
+    return true;
+}
+
 void Speller::set_limiting_behaviour(int nbest, Weight maxweight, Weight beam)
 {
     limiting = None;
@@ -1085,6 +3177,7 @@ bool Speller::check(char * line)
     while (queue.size() > 0) {
         next_node = queue.back();
         queue.pop_back();
+        trace_visit();
         if (next_node.input_state == input.size() &&
             lexicon->is_final(next_node.lexicon_state)) {
             return true;
@@ -1200,6 +3293,14 @@ bool Speller::init_input(char * line)
             input.push_back(k);
         }
     }
+    if (case_folding) {
+        // the letters just added to the alphabets can have other cases
+        if (mutator != NULL && mode != Check) {
+            add_case_variants(mutator, mutator_case_variants);
+        } else {
+            add_case_variants(lexicon, lexicon_case_variants);
+        }
+    }
     return true;
 }
 
@@ -1208,6 +3309,41 @@ void Speller::add_symbol_to_alphabet_translator(SymbolNumber to_sym)
     alphabet_translator.push_back(to_sym);
 }
 
+bool Speller::has_new_symbols(const char * line)
+{
+    for (Transducer * t : {lexicon, mutator}) {
+        if (t == NULL) {
+            continue;
+        }
+        char * p = const_cast<char *>(line);
+        while (*p != '\0') {
+            if (t->get_encoder()->find_key(&p) == NO_SYMBOL) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void Speller::sync_symbols(void)
+{
+    if (mutator == NULL) {
+        return;
+    }
+    KeyTable * from_keys = mutator->get_key_table();
+    StringSymbolMap * to_symbols = lexicon->get_alphabet()->get_string_to_symbol();
+    while (alphabet_translator.size() < from_keys->size()) {
+        // init_input() adds the symbol to the lexicon first
+        StringSymbolMap::const_iterator it =
+            to_symbols->find(from_keys->at(alphabet_translator.size()));
+        add_symbol_to_alphabet_translator(
+            it == to_symbols->end() ? NO_SYMBOL : it->second);
+    }
+    if (cache.size() < from_keys->size()) {
+        cache.resize(from_keys->size());
+    }
+}
+
 } // namespace hfst_ospell
 
 char*
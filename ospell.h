@@ -21,6 +21,8 @@
 #include <deque>
 #include <queue>
 #include <list>
+#include <unordered_map>
+#include <memory>
 #include <stdexcept>
 #include <limits>
 #include <ctime>
@@ -181,6 +183,194 @@ struct WeightQueue: public std::list<Weight>
     Weight get_highest(void) const;
 };
 
+//! @brief Bytes held by the data structures of spellers.
+struct MemoryReport
+{
+    size_t index_tables; //!< index tables of the automata
+    size_t transition_tables; //!< transition tables of the automata
+    size_t symbol_tables; //!< key tables, symbol maps and flag operations
+    size_t letter_tries; //!< encoders used for reading input
+    size_t mutator_table; //!< error model arcs laid out for searching
+    size_t symbol_sets; //!< lexicon input symbols of the states visited
+    size_t cache_nodes; //!< search nodes cached after the first symbol
+    size_t result_caches; //!< corrections cached for short inputs
+    size_t suffix_memo; //!< completions of word endings
+    size_t completions; //!< completion index of the dictionary
+    size_t case_variants; //!< other cases of the symbols
+    size_t state_traces; //!< state visits counted while tracing
+    size_t other; //!< the objects themselves and their search state
+
+    MemoryReport(void):
+        index_tables(0), transition_tables(0), symbol_tables(0),
+        letter_tries(0), mutator_table(0), symbol_sets(0), cache_nodes(0),
+        result_caches(0), suffix_memo(0), completions(0), case_variants(0),
+        state_traces(0), other(0)
+        {}
+    //!
+    //! sum of all the parts
+    size_t total(void) const;
+    //!
+    //! add the bytes of @a report
+    void merge(const MemoryReport & report);
+};
+
+//! @brief What the searches of a speller have done so far, to see whether
+//!        its caches and limits take effect.
+struct SearchStatistics
+{
+    unsigned long corrections; //!< correction searches
+    unsigned long cache_warmed; //!< cache entries built by warm_cache()
+    unsigned long cache_loaded; //!< cache entries read by load_cache()
+    unsigned long cache_built; //!< cache entries built while correcting
+    unsigned long cache_hits; //!< corrections that found their entry built
+    unsigned long suffix_memo_hits; //!< word endings found in the memo
+    unsigned long suffix_memo_misses; //!< word endings searched for the memo
+    unsigned long truncated; //!< corrections stopped early
+    unsigned long sessions_resumed; //!< corrections going on from a session
+    unsigned long session_fallbacks; //!< session corrections done afresh
+    unsigned long completions_loaded; //!< states read by load_completions()
+    unsigned long completions_searched; //!< states searched for completions
+
+    SearchStatistics(void):
+        corrections(0), cache_warmed(0), cache_loaded(0), cache_built(0),
+        cache_hits(0), suffix_memo_hits(0), suffix_memo_misses(0),
+        truncated(0), sessions_resumed(0), session_fallbacks(0),
+        completions_loaded(0), completions_searched(0)
+        {}
+    //!
+    //! add the counts of @a other
+    void merge(const SearchStatistics & other);
+};
+
+//! @brief Number of times each lexicon and error model state was visited
+//!        while searching, to lay out the busiest states together.
+struct StateTrace
+{
+    std::map<TransitionTableIndex, unsigned long> lexicon; //!< visits per lexicon state
+    std::map<TransitionTableIndex, unsigned long> mutator; //!< visits per error model state
+
+    //!
+    //! add the visits of @a other
+    void merge(const StateTrace & other);
+    //!
+    //! write the visits as lines of automaton, state and count
+    std::string dump(void) const;
+    //!
+    //! add the visits written by dump(), false if @a data is broken
+    bool load(const std::string & data);
+};
+
+//! @brief The completions found from one search state over the rest of the
+//!        input, shared by the words that end the same way.
+struct SuffixMemoEntry
+{
+    //! output symbols and weight of each completion
+    std::vector<std::pair<SymbolVector, Weight> > completions;
+    Weight bound; //!< every completion up to this weight is included
+    size_t bytes; //!< bytes held by the entry
+    unsigned long last_used; //!< query count when last used
+};
+
+//! @brief The cheapest ways to finish a word from one lexicon state and
+//!        flag state, with their output symbols kept in one array.
+struct CompletionEntry
+{
+    std::vector<SymbolNumber> symbols; //!< output of all the completions
+    std::vector<uint32_t> ends; //!< end of each completion in symbols
+    std::vector<Weight> weights; //!< weight of each completion, best first
+
+    //!
+    //! number of completions
+    size_t size(void) const
+        {
+            return weights.size();
+        }
+};
+
+class Transducer;
+
+//! @brief An error model arc with its output already in lexicon symbols.
+struct MutatorArc
+{
+    SymbolNumber output; //!< lexicon symbol written, 0 for none
+    TransitionTableIndex target; //!< error model state reached
+    Weight weight; //!< weight of the arc
+};
+
+//! @brief The error model compiled into the arcs of each state and input
+//!        symbol, so that the search walks arrays instead of the tables.
+class MutatorTable
+{
+    //! dense number + 1 of each index table state, 0 if unreachable
+    std::vector<uint32_t> index_states;
+    //! same for the transition table states
+    std::vector<uint32_t> transition_states;
+    SymbolNumber symbols; //!< input symbols per state
+    std::vector<uint32_t> offsets; //!< first arc per state and input symbol
+    std::vector<MutatorArc> arcs; //!< arcs in state and input symbol order
+    //! words in the output set of each state and input symbol, 0 if none
+    size_t output_words;
+    //! bit per lexicon symbol output by the arcs of each state and input
+    //! symbol; bit 0 marks outputs of nothing or of symbols the lexicon
+    //! did not have
+    std::vector<uint64_t> output_sets;
+public:
+    MutatorTable(void): symbols(0), output_words(0) {}
+    //!
+    //! compile the states of @a mutator reachable from the start, mapping
+    //! outputs through @a translator into the @a lexicon_symbols of the
+    //! lexicon; false and left empty if that would take more than
+    //! @a max_cells states times input symbols
+    bool build(Transducer * mutator, const SymbolVector & translator,
+               SymbolNumber lexicon_symbols, size_t max_cells);
+    //!
+    //! whether nothing was compiled
+    bool empty(void) const
+        {
+            return offsets.empty();
+        }
+    //!
+    //! words in each output set, 0 if there are none
+    size_t get_output_words(void) const
+        {
+            return output_words;
+        }
+    //!
+    //! set [@a first, @a last) to the arcs of @a state reading @a input
+    //! and @a outputs to their output set or NULL, false if there are none
+    bool find(TransitionTableIndex state, SymbolNumber input,
+              const MutatorArc *& first, const MutatorArc *& last,
+              const uint64_t *& outputs) const
+        {
+            if (input >= symbols) {
+                return false;
+            }
+            uint32_t id = 0;
+            if (state >= TARGET_TABLE) {
+                if (state - TARGET_TABLE < transition_states.size()) {
+                    id = transition_states[state - TARGET_TABLE];
+                }
+            } else if (state < index_states.size()) {
+                id = index_states[state];
+            }
+            if (id == 0) {
+                return false;
+            }
+            size_t cell = static_cast<size_t>(id - 1) * symbols + input;
+            if (offsets[cell] == offsets[cell + 1]) {
+                return false;
+            }
+            first = arcs.data() + offsets[cell];
+            last = arcs.data() + offsets[cell + 1];
+            outputs = output_words == 0 ? NULL
+                : output_sets.data() + cell * output_words;
+            return true;
+        }
+    //!
+    //! bytes held by the table
+    size_t memory_size(void) const;
+};
+
 //! Internal class for Transducer processing.
 
 //! Contains low-level processing stuff.
@@ -193,6 +383,12 @@ protected:
     Encoder encoder; //!< encoder to convert the strings
 
     static const TransitionTableIndex START_INDEX = 0; //!< position of first
+    std::vector<Weight> index_min_costs; //!< least cost to final per index
+    std::vector<Weight> transition_min_costs; //!< same for transition table
+    bool nonnegative_arcs; //!< whether no arc has a negative weight
+    void read_min_costs(FILE * f);
+    void read_min_costs(char ** raw);
+    void prepare_runs(void);
   
 public:
     //! 
@@ -277,6 +473,22 @@ public:
     //!
     //! whether it's weighedc
     bool is_weighted(void);
+    //!
+    //! whether the optimizer stored least costs to a final state
+    bool has_min_costs(void) const;
+    //!
+    //! whether no arc has a negative weight; the arcs of each run are
+    //! always sorted by weight once loaded
+    bool has_nonnegative_arcs(void) const;
+    //!
+    //! least weight from state @a i to a final state, 0 if not known
+    Weight min_cost(const TransitionTableIndex i) const;
+    //!
+    //! add the bytes held by this automaton to @a report
+    void count_memory(MemoryReport & report) const;
+    //!
+    //! hash the tables and symbols of the automaton into @a hash
+    uint64_t hash(uint64_t hash) const;
 
 };
 
@@ -328,7 +540,7 @@ struct TreeNode
     //! traverse some node in lexicon
     TreeNode update_lexicon(SymbolNumber next_symbol,
                             TransitionTableIndex next_lexicon,
-                            Weight weight);
+                            Weight weight) const;
 
     //!
     //! traverse some node in error model
@@ -353,6 +565,20 @@ struct TreeNode
 
 typedef std::vector<TreeNode> TreeNodeQueue;
 
+//! @brief The search for corrections of a word being typed, kept between
+//!        keystrokes by Speller::correct().
+struct CorrectionSession
+{
+    SymbolVector input; //!< the input last searched
+    //! the nodes that have read the first i symbols of the input, for
+    //! each i searched so far
+    std::vector<TreeNodeQueue> frontiers;
+    Weight bound; //!< weight limit the frontiers were searched with
+    uint64_t key; //!< cache_key() of the speller they were searched by
+
+    CorrectionSession(void): bound(0.0), key(0) {}
+};
+
 int nByte_utf8(unsigned char c);
 
 //! Exception when speller cannot map characters of error model to language
@@ -389,9 +615,68 @@ public:
     Weight best_suggestion; //!< best suggestion so far
     WeightQueue nbest_queue; //!< queue to keep track of current n best results
     SymbolVector alphabet_translator; //!< alphabets in automata
+    //!< the error model arcs with translated outputs, if it was small
+    //!< enough, shared with the copies of the speller as the automata are
+    std::shared_ptr<const MutatorTable> mutator_table;
+    //!< offsets of the symbol sets of lexicon index states into
+    //!< lexicon_symbol_bits, filled as the states are visited
+    std::unordered_map<TransitionTableIndex, size_t> lexicon_symbol_sets;
+    //!< bit per symbol each of those states has arcs for
+    std::vector<uint64_t> lexicon_symbol_bits;
+    //!< the symbol set of the current transition table state
+    std::vector<uint64_t> lexicon_symbol_scratch;
     OperationMap * operations; //!< flags in it
     //!< A cache for the result of first symbols
     std::vector<CacheContainer> cache;
+    //!< bytes held by the built cache entries
+    size_t cache_size;
+    //!< bytes the cache may hold, or 0 for no limit
+    size_t cache_budget;
+    //!< hash of the automata for cache_key(), once automata_hashed
+    mutable uint64_t automata_hash;
+    //!< whether the automata have been hashed yet
+    mutable bool automata_hashed;
+    //!< whether both automata have least costs to a final state
+    bool use_min_costs;
+    //!< whether the lexicon has flag diacritics
+    bool lexicon_has_flags;
+    //!< whether the lexicon has an identity symbol
+    bool lexicon_has_identity;
+    //!< whether visits to states are counted in trace
+    bool tracing;
+    //!< states visited while tracing
+    StateTrace trace;
+    //!< completions by search state and rest of input, kept across queries
+    std::unordered_map<std::string, SuffixMemoEntry> suffix_memo;
+    //!< bytes held by the suffix memo
+    size_t suffix_memo_size;
+    //!< bytes the suffix memo may hold, or 0 for no memo
+    size_t suffix_memo_budget;
+    //!< longest rest of input looked up in the suffix memo
+    unsigned int suffix_memo_length;
+    //!< corrections asked so far, for dropping the oldest memo entries
+    unsigned long query_count;
+    //!< what the searches have done so far
+    SearchStatistics statistics;
+    //!< most search nodes expanded per correction, or 0 for no limit
+    unsigned long node_budget;
+    //!< whether the last correction stopped at its time or node budget
+    bool truncated;
+    //!< whether input letters also match their other case
+    bool case_folding;
+    //!< the symbols of the other case of each lexicon symbol, filled as
+    //!< the symbols are read when case folding
+    std::vector<SymbolVector> lexicon_case_variants;
+    //!< the same for the error model symbols
+    std::vector<SymbolVector> mutator_case_variants;
+    //!< cheapest completions by lexicon state and flags, filled by
+    //!< build_completions() or load_completions()
+    std::unordered_map<std::string, CompletionEntry> completions;
+    //!< the same for states outside the index that complete() reached
+    //!< lately, dropped when it gets too big
+    std::unordered_map<std::string, CompletionEntry> completion_memo;
+    //!< completions kept per state
+    unsigned int completion_count;
     //!< what kind of limiting behaviour we have
     enum LimitingBehaviour { None, MaxWeight, Nbest, Beam, MaxWeightNbest,
                              MaxWeightBeam, NbestBeam, MaxWeightNbestBeam } limiting;
@@ -410,6 +695,15 @@ public:
     //!
     //! Create a speller object form error model and language automata.
     Speller(Transducer * mutator_ptr, Transducer * lexicon_ptr);
+    //! what a speller made for searching alongside another one is
+    //! constructed with
+    struct SearchClone {};
+    //!
+    //! Create a speller searching like @a other with its automata, error
+    //! model table and settings, but none of its caches, memos,
+    //! completions or trace, for a thread of a search split between
+    //! threads.
+    Speller(const Speller & other, SearchClone);
     //!
     //! size of states
     SymbolNumber get_state_size(void);
@@ -418,6 +712,13 @@ public:
     void build_alphabet_translator(void);
     void add_symbol_to_alphabet_translator(SymbolNumber to_sym);
     //!
+    //! whether init_input() would add symbols to the automata for @a line
+    bool has_new_symbols(const char * line);
+    //!
+    //! catch up with the symbols that copies of this speller sharing its
+    //! automata have added
+    void sync_symbols(void);
+    //!
     //! initialize input string
     bool init_input(char * line);
     //!
@@ -437,13 +738,35 @@ public:
     //!
     //! traverse along input
     void consume_input();
+    //! traverse along input symbol @a input_sym of the error model
+    void consume_input_symbol(SymbolNumber input_sym);
     //! helper functions for traversal
     void queue_mutator_arcs(SymbolNumber input);
+    void queue_mutator_table_arcs(const MutatorArc * arc,
+                                  const MutatorArc * last,
+                                  const uint64_t * outputs,
+                                  int input_increment);
+    //!
+    //! bit per symbol the current lexicon state has arcs for, sized as the
+    //! output sets of mutator_table, or NULL if there are no sets
+    const uint64_t * lexicon_symbol_set(void);
     void lexicon_consume(void);
+    //! traverse the lexicon along input symbol @a this_input
+    void lexicon_consume_symbol(SymbolNumber this_input);
     void queue_lexicon_arcs(SymbolNumber input,
                             unsigned int mutator_state,
                             Weight mutator_weight = 0.0,
                             int input_increment = 0);
+    //! the lexicon traversals compiled for correcting or not and for
+    //! lexicons with or without flags and identities, picked per node
+    //! instead of testing them per arc
+    template <bool correcting, bool flags>
+    void lexicon_epsilons_kernel(void);
+    template <bool correcting, bool identity>
+    void queue_lexicon_arcs_kernel(SymbolNumber input,
+                                   unsigned int mutator_state,
+                                   Weight mutator_weight,
+                                   int input_increment);
     //! @brief Check if the given string is accepted by the speller
     //
     //! foo
@@ -456,8 +779,49 @@ public:
                             Weight maxweight = -1.0,
                             Weight beam = -1.0,
                             float time_cutoff = 0.0);
+    //! @brief suggest corrections for all the spellings @a lines of one
+    //! word in a single search.
+    //
+    //! Corrections of @a lines[i] weigh @a offsets[i] more, which
+    //! @a maxweight does not count. The search nodes of all the lines
+    //! share one queue, weight limit and n-best list, so a line is only
+    //! searched while it can still give one of the best corrections.
+    //! @return the corrections of each line, in the order of @a lines
+    std::vector<CorrectionQueue> correct(const std::vector<char *> & lines,
+                                         const std::vector<Weight> & offsets,
+                                         int nbest = 0,
+                                         Weight maxweight = -1.0,
+                                         Weight beam = -1.0,
+                                         float time_cutoff = 0.0);
+
+    //! @brief suggest corrections for @a line like correct(), resuming
+    //!        the search kept in @a session from the longest prefix
+    //!        @a line shares with the input it was last used for.
+    //
+    //! Typing a letter then only searches from the nodes of the word so
+    //! far, and deleting one goes back to the nodes kept for the shorter
+    //! word. The nodes are searched with @a maxweight as the only limit;
+    //! @a nbest and @a beam pick among the corrections found. Without a
+    //! weight limit, when the nodes to keep would be too many or when the
+    //! node budget runs out before the end of @a line, the session is
+    //! dropped and @a line corrected like correct() does, which gives
+    //! the best corrections found within the budget as truncated.
+    CorrectionQueue correct(CorrectionSession & session, char * line,
+                            int nbest = 0, Weight maxweight = -1.0,
+                            Weight beam = -1.0);
+    //! @brief add to @a session the nodes that have read one more symbol
+    //!        of the input than the last of its frontiers, keeping the
+    //!        lightest of the nodes alike in all but weight.
+    //! @return false if the session would then keep too many nodes or
+    //!         the node budget runs out first
+    bool extend_session(CorrectionSession & session);
 
     bool is_under_weight_limit(Weight w) const;
+    //! also check that a final state is reachable from the states within
+    //! the limit
+    bool is_under_weight_limit(Weight w,
+                               TransitionTableIndex mutator_state,
+                               TransitionTableIndex lexicon_state) const;
     void set_limiting_behaviour(int nbest, Weight maxweight, Weight beam);
     void adjust_weight_limits(int nbest, Weight beam);
     
@@ -478,24 +842,162 @@ public:
     void build_cache(SymbolNumber first_sym);
     //! @brief Construct a cache entry for @a first_sym..
 
+    //! @brief the cache entry for @a first_sym, built first if needed.
+    CacheContainer & first_symbol_cache(SymbolNumber first_sym);
+
+    //! @brief build the cache entries of all error model symbols not built
+    //!        yet, using @a threads threads or one per core if 0.
+    void warm_cache(unsigned int threads = 0);
+    //! @brief limit the cache to @a bytes, or no limit if 0.
+    void set_cache_budget(size_t bytes);
+    //! @brief drop the least used entries other than @a keep until the
+    //!        cache fits in its budget.
+    void enforce_cache_budget(SymbolNumber keep = NO_SYMBOL);
+
+    //! @brief count the bytes held by the speller and, unless
+    //!        @a count_automata is false as for copies sharing them, its
+    //!        automata and error model table.
+    MemoryReport memory_report(bool count_automata = true) const;
+    //! @brief bytes held by the cache and suffix memo, which grow while
+    //!        correcting, without walking them.
+    size_t search_memory_size(void) const;
+
+    //! @brief keep the completions of the last @a length input symbols
+    //!        across queries in at most @a bytes, or not at all if 0.
+    void set_suffix_memo(size_t bytes, unsigned int length = 4);
+    //! @brief find the completions of next_node in the suffix memo, or
+    //!        search them and remember them. None are given or kept if
+    //!        the time cutoff is reached during the search.
+    const SuffixMemoEntry & suffix_completions(void);
+    //! @brief drop the least recently used memo entries until the memo
+    //!        fits in its budget.
+    void enforce_suffix_memo_budget(void);
+
+    //! @brief stop correcting after expanding @a nodes search nodes, or
+    //!        never if 0.
+    //!
+    //! Unlike the time cutoff, the results then only depend on the input.
+    void set_node_budget(unsigned long nodes);
+
+    //! @brief let each input letter also match the letters of its other
+    //!        case in the automata's alphabets, and give corrections the
+    //!        capitalization of the input.
+    //!
+    //! Drops the cache and the suffix memo, which depend on this.
+    void set_case_folding(bool on);
+    //! @brief fill @a variants with the other case symbols of the symbols
+    //!        of @a transducer not done yet.
+    void add_case_variants(Transducer * transducer,
+                           std::vector<SymbolVector> & variants);
+
+    //! @brief give the @a nbest cheapest words of the lexicon starting with
+    //!        @a line, or as many as are kept per state if 0.
+    //
+    //! Only the lexicon is searched: it is walked along @a line and the
+    //! completions of the states reached are looked up in the completion
+    //! index, or searched and kept for a while for the next words with
+    //! the same prefix. No more completions than are kept per state are
+    //! found from each state, however big @a nbest is.
+    CorrectionQueue complete(char * line, int nbest = 0,
+                             Weight maxweight = -1.0);
+    //! @brief the completions from the lexicon state and flags of @a node,
+    //!        from the index or the memo, or searched and memoized.
+    const CompletionEntry & state_completions(const TreeNode & node);
+    //! @brief search the cheapest completions from the lexicon state and
+    //!        flags of @a node.
+    CompletionEntry search_completions(const TreeNode & node);
+    //! @brief add the nodes reached from @a node by one lexicon arc to
+    //!        @a successors, without the unknown and identity symbols.
+    void lexicon_successors(const TreeNode & node,
+                            TreeNodeQueue & successors);
+    //! @brief keep @a count completions per state; drops the index if
+    //!        that changes, so it is set before the index is built.
+    void set_completion_count(unsigned int count);
+    //! @brief fill the completion index for the states reached by all
+    //!        prefixes of up to @a depth symbols.
+    void build_completions(unsigned int depth);
+    //! @brief serialize the completion index for load_completions().
+    std::string dump_completions(void) const;
+    //! @brief fill the completion index from the output of
+    //!        dump_completions().
+    //
+    //! Returns false and leaves the index as it was if @a data was dumped
+    //! from another lexicon, on another platform or is broken.
+    bool load_completions(const std::string & data);
+
+    //! @brief start or stop counting the states visited in trace.
+    void set_tracing(bool on);
+    //! @brief count a visit to the states of next_node when tracing.
+    void trace_visit(void);
+
+    //! @brief identify the automata the cache is built from.
+    uint64_t cache_key(void) const;
+    //! @brief serialize the built cache entries for load_cache().
+    std::string dump_cache(void) const;
+    //! @brief fill the cache from the output of dump_cache().
+    //
+    //! Returns false and leaves the cache as it was if @a data was dumped
+    //! from other automata, on another platform or is broken.
+    bool load_cache(const std::string & data);
+
+};
+
+//! @brief A search node kept in the cache after the first input symbol.
+
+//! The output and flag state of the node are kept in the symbols and flags
+//! of its CacheContainer, and its input state is always 1.
+struct CachedNode
+{
+    TransitionTableIndex mutator_state; //!< state in error model
+    TransitionTableIndex lexicon_state; //!< state in language model
+    Weight weight; //!< weight
+    uint32_t string_start; //!< position of output in the symbols
+    uint32_t string_length; //!< length of output
+    uint32_t flags_start; //!< position of flag state in the flags
 };
 
 struct CacheContainer
 {
     // All the nodes that ultimately result from searching at input depth 1
-    TreeNodeVector nodes;
+    std::vector<CachedNode> nodes;
+    // Outputs of the nodes one after another
+    SymbolVector symbols;
+    // Flag states of the nodes, shared by consecutive nodes when equal
+    FlagDiacriticState flags;
     // The results are for length max one inputs only
     StringWeightVector results_len_0;
     StringWeightVector results_len_1;
     bool empty;
+    // How often the entry has been used, halved on each eviction
+    unsigned long hits;
+
+    CacheContainer(void): empty(true), hits(0) {}
 
-    CacheContainer(void): empty(true) {}
+    //!
+    //! store a search node at input depth 1
+    void add_node(const TreeNode & node);
+    //!
+    //! add the stored nodes to a search @a queue, at @a input_state and
+    //! with @a weight added
+    void restore_nodes(TreeNodeQueue & queue, SymbolNumber state_size,
+                       unsigned int input_state = 1,
+                       Weight weight = 0.0) const;
+    //!
+    //! bytes held by the entry
+    size_t memory_size(void) const;
+    //!
+    //! add the bytes held by the cached nodes and results to @a report
+    void count_memory(MemoryReport & report) const;
     
     void clear(void)
         {
-            nodes.clear();
-            results_len_0.clear();
-            results_len_1.clear();
+            // swap to really give the memory back
+            std::vector<CachedNode>().swap(nodes);
+            SymbolVector().swap(symbols);
+            FlagDiacriticState().swap(flags);
+            StringWeightVector().swap(results_len_0);
+            StringWeightVector().swap(results_len_1);
+            empty = true;
         }
     
 };
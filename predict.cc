@@ -35,6 +35,7 @@
 #include <windows.h>
 #endif
 
+#include <algorithm>
 #include <cstdarg>
 #include <errno.h>
 #include <stdio.h>
@@ -56,6 +57,13 @@ static float time_cutoff = 0.0;
 static std::string error_model_filename = "";
 static std::string lexicon_filename = "";
 static std::string continuation_marker = "";
+static bool complete = false;
+static std::string completion_filename = "";
+static unsigned int completion_depth = 3;
+static unsigned int completion_count = 0;
+static bool incremental = false;
+//! search of the line before, for incremental correction
+static hfst_ospell::CorrectionSession session;
 #ifdef WINDOWS
 static bool output_to_console = false;
 #endif
@@ -152,6 +160,19 @@ print_usage(void)
         << "  -t, --time-cutoff=T       Stop trying to find better "
            "corrections after T seconds (T is a float)\n"
         << "  -C, --continuation=C      Word-continuation character is C\n"
+        << "  -c, --complete            Complete prefixes from the lexicon only,\n"
+           "                            without the error model\n"
+        << "      --completion-file=FILE\n"
+           "                            Read the completion index from FILE, or\n"
+           "                            build it and write it to FILE if it does\n"
+           "                            not match\n"
+        << "      --completion-depth=N  Build the index for prefixes of up to N\n"
+           "                            symbols (default: 3)\n"
+        << "      --completion-count=N  Keep N completions per state in the\n"
+           "                            index (default: 10, or as many as -n)\n"
+        << "  -i, --incremental         Correct each line going on from the\n"
+           "                            search of the line before, as when\n"
+           "                            the word is typed, with --max-weight\n"
         << "  -m, --error-model         Use this error model (must also give "
            "lexicon as option)\n"
         << "  -l, --lexicon             Use this lexicon (must also give erro "
@@ -191,7 +212,8 @@ do_predict(ZHfstOspeller &speller, const std::string &str)
     {
         hfst_fprintf(stdout, "Suggesting for %s:\n", str.c_str());
     }
-    hfst_ospell::CorrectionQueue corrections = speller.suggest(str);
+    hfst_ospell::CorrectionQueue corrections = incremental
+        ? speller.suggest(session, str) : speller.suggest(str);
     if (corrections.size() > 0)
     {
         hfst_fprintf(stdout, "Corrections for \"%s\":\n", str.c_str());
@@ -256,9 +278,66 @@ do_predict(ZHfstOspeller &speller, const std::string &str)
     }
 }
 
+void
+do_complete(ZHfstOspeller &speller, const std::string &str)
+{
+    hfst_ospell::CorrectionQueue completions = speller.complete(str);
+    if (completions.size() > 0)
+    {
+        hfst_fprintf(stdout, "Completions for \"%s\":\n", str.c_str());
+        while (completions.size() > 0)
+        {
+            hfst_fprintf(stdout, "%s    %f\n",
+                         completions.top().first.c_str(),
+                         completions.top().second);
+            completions.pop();
+        }
+        hfst_fprintf(stdout, "\n");
+    }
+    else
+    {
+        hfst_fprintf(stdout, "Unable to complete \"%s\"!\n\n", str.c_str());
+    }
+}
+
+void
+set_completion_count(ZHfstOspeller &speller)
+{
+    // the index is built to answer as many as asked for; one read from a
+    // file or the archive keeps its own count
+    unsigned int count = std::max<unsigned long>(completion_count, suggs);
+    if (count != 0)
+    {
+        speller.set_completion_count(count);
+    }
+}
+
+void
+prepare_completions(ZHfstOspeller &speller)
+{
+    if (completion_filename.empty())
+    {
+        return;
+    }
+    if (!speller.read_completions(completion_filename))
+    {
+        speller.build_completions(completion_depth);
+        if (!speller.write_completions(completion_filename))
+        {
+            hfst_fprintf(stderr, "cannot write completions to %s\n",
+                         completion_filename.c_str());
+        }
+    }
+}
+
 void
 do_spell(ZHfstOspeller &speller, const std::string &str)
 {
+    if (complete)
+    {
+        do_complete(speller, str);
+        return;
+    }
     if (speller.spell(str))
     {
         hfst_fprintf(stdout, "\"%s\" is in the lexicon...\n", str.c_str());
@@ -308,6 +387,10 @@ zhfst_spell(char *zhfst_filename)
     try
     {
         speller.read_zhfst(zhfst_filename);
+        set_completion_count(speller);
+        // errors in the automata are reported here, not at the first word
+        speller.load_speller();
+        prepare_completions(speller);
     }
     catch (hfst_ospell::ZHfstMetaDataParsingError &zhmdpe)
     {
@@ -404,6 +487,22 @@ zhfst_spell(char *zhfst_filename)
         do_spell(speller, str);
     }
     free(str);
+    if (complete && verbose)
+    {
+        hfst_ospell::SearchStatistics statistics = speller.search_statistics();
+        hfst_fprintf(stdout, "Completion index entries loaded: %lu\n",
+                     statistics.completions_loaded);
+        hfst_fprintf(stdout, "States searched for completions: %lu\n",
+                     statistics.completions_searched);
+    }
+    if (incremental && verbose)
+    {
+        hfst_ospell::SearchStatistics statistics = speller.search_statistics();
+        hfst_fprintf(stdout, "Corrections going on from the line before: %lu\n",
+                     statistics.sessions_resumed);
+        hfst_fprintf(stdout, "Corrections searched from scratch: %lu\n",
+                     statistics.session_fallbacks);
+    }
     return EXIT_SUCCESS;
 }
 
@@ -412,6 +511,8 @@ legacy_spell(hfst_ospell::Speller *s)
 {
     ZHfstOspeller speller;
     speller.inject_speller(s);
+    set_completion_count(speller);
+    prepare_completions(speller);
     speller.set_queue_limit(suggs);
     if (suggs != 0 && verbose)
     {
@@ -494,6 +595,11 @@ main(int argc, char **argv)
                 { "error-model", required_argument, 0, 'm' },
                 { "lexicon", required_argument, 0, 'l' },
                 { "continuation", required_argument, 0, 'C' },
+                { "complete", no_argument, 0, 'c' },
+                { "completion-file", required_argument, 0, 'F' },
+                { "completion-depth", required_argument, 0, 'D' },
+                { "completion-count", required_argument, 0, 'N' },
+                { "incremental", no_argument, 0, 'i' },
 #ifdef WINDOWS
                 { "output-to-console", no_argument, 0, 'k' },
 #endif
@@ -501,7 +607,7 @@ main(int argc, char **argv)
               };
 
         int option_index = 0;
-        c = getopt_long(argc, argv, "hVvqsan:w:b:t:SXm:l:kC:", long_options,
+        c = getopt_long(argc, argv, "hVvqsan:w:b:t:SXm:l:kC:ci", long_options,
                         &option_index);
         char *endptr = 0;
 
@@ -598,6 +704,31 @@ main(int argc, char **argv)
         case 'C':
             continuation_marker = optarg;
             break;
+        case 'c':
+            complete = true;
+            break;
+        case 'i':
+            incremental = true;
+            break;
+        case 'F':
+            completion_filename = optarg;
+            break;
+        case 'D':
+            completion_depth = strtoul(optarg, &endptr, 10);
+            if (endptr == optarg)
+            {
+                fprintf(stderr, "%s not a strtoul number\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'N':
+            completion_count = strtoul(optarg, &endptr, 10);
+            if (endptr == optarg)
+            {
+                fprintf(stderr, "%s not a strtoul number\n", optarg);
+                exit(1);
+            }
+            break;
         default:
             std::cerr << "Invalid option\n\n";
             print_short_help();
@@ -608,6 +739,12 @@ main(int argc, char **argv)
 #else
     int optind = 1;
 #endif
+    if (incremental && max_weight < 0.0)
+    {
+        std::cerr << "--incremental without --max-weight would keep every "
+                     "search node, so each line is corrected from scratch"
+                  << std::endl;
+    }
     // no more options, we should now be at the input filenames
     if (optind == (argc - 1))
     {
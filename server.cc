@@ -0,0 +1,390 @@
+/* -*- Mode: C++ -*- */
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <set>
+#include <vector>
+
+#ifndef WINDOWS
+#  include <sys/types.h>
+#  include <sys/socket.h>
+#  include <sys/stat.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#  include <signal.h>
+#  include <pthread.h>
+#endif
+
+#include "server.h"
+
+namespace hfst_ospell
+  {
+
+#ifndef WINDOWS
+
+//! longest request a client may send
+static const size_t MAX_REQUEST_LENGTH = 1 << 16;
+
+//! read exactly @a length bytes from @a fd, false at end of input or error
+static bool
+read_fully(int fd, char* buffer, size_t length)
+  {
+    while (length > 0)
+      {
+        ssize_t got = recv(fd, buffer, length, 0);
+        if (got < 0 && errno == EINTR)
+          {
+            continue;
+          }
+        if (got <= 0)
+          {
+            return false;
+          }
+        buffer += got;
+        length -= got;
+      }
+    return true;
+  }
+
+//! write all of @a data to @a fd, false if the client has gone
+static bool
+write_fully(int fd, const char* data, size_t length)
+  {
+    while (length > 0)
+      {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+          {
+            continue;
+          }
+        if (sent <= 0)
+          {
+            return false;
+          }
+        data += sent;
+        length -= sent;
+      }
+    return true;
+  }
+
+static bool
+read_message(int fd, std::string& message)
+  {
+    unsigned char header[4];
+    if (!read_fully(fd, reinterpret_cast<char*>(header), 4))
+      {
+        return false;
+      }
+    size_t length = (size_t(header[0]) << 24) | (size_t(header[1]) << 16) |
+        (size_t(header[2]) << 8) | size_t(header[3]);
+    if (length > MAX_REQUEST_LENGTH)
+      {
+        return false;
+      }
+    message.resize(length);
+    return (length == 0) || read_fully(fd, &message[0], length);
+  }
+
+static bool
+write_message(int fd, const std::string& message)
+  {
+    unsigned char header[4] = {
+        static_cast<unsigned char>(message.size() >> 24),
+        static_cast<unsigned char>(message.size() >> 16),
+        static_cast<unsigned char>(message.size() >> 8),
+        static_cast<unsigned char>(message.size())
+    };
+    return write_fully(fd, reinterpret_cast<char*>(header), 4) &&
+        write_fully(fd, message.data(), message.size());
+  }
+
+//! one "STRING<tab>WEIGHT" line per result of @a results
+template <typename Queue>
+static std::string
+format_results(Queue results)
+  {
+    std::string reply;
+    char weight[32];
+    while (results.size() > 0)
+      {
+        snprintf(weight, sizeof(weight), "\t%f\n", results.top().second);
+        reply += results.top().first;
+        reply += weight;
+        results.pop();
+      }
+    return reply;
+  }
+
+static std::string
+answer(ZHfstOspeller& speller, const std::string& request)
+  {
+    size_t space = request.find(' ');
+    std::string verb = request.substr(0, space);
+    std::string word = (space == std::string::npos) ? "" :
+        request.substr(space + 1);
+    if (verb == "spell")
+      {
+        return speller.spell(word) ? "1" : "0";
+      }
+    else if (verb == "suggest")
+      {
+        return format_results(speller.suggest(word));
+      }
+    else if (verb == "analyse")
+      {
+        return format_results(speller.analyse(word));
+      }
+    return "error: unknown request " + verb;
+  }
+
+//! the accepted clients waiting for a worker and those being served
+struct ClientQueue
+  {
+    std::mutex mutex;
+    std::condition_variable waiting;
+    std::deque<int> clients;
+    std::set<int> served;
+    bool stopping = false;
+  };
+
+static void
+serve_client(ZHfstOspellerHandle* spellers, int fd)
+  {
+    std::string request;
+    while (read_message(fd, request))
+      {
+        std::string reply;
+        try
+          {
+            // a reload during the request leaves this speller alive
+            std::shared_ptr<ZHfstOspeller> speller = spellers->get();
+            reply = answer(*speller, request);
+          }
+        catch (std::exception& e)
+          {
+            reply = std::string("error: ") + e.what();
+          }
+        if (!write_message(fd, reply))
+          {
+            break;
+          }
+      }
+  }
+
+//! serve the clients of @a queue one at a time until it is stopped
+static void
+serve_clients(ZHfstOspellerHandle* spellers, ClientQueue* queue)
+  {
+    while (true)
+      {
+        int fd;
+          {
+            std::unique_lock<std::mutex> lock(queue->mutex);
+            queue->waiting.wait(lock, [queue]
+                { return queue->stopping || !queue->clients.empty(); });
+            if (queue->stopping)
+              {
+                return;
+              }
+            fd = queue->clients.front();
+            queue->clients.pop_front();
+            queue->served.insert(fd);
+          }
+        serve_client(spellers, fd);
+        // closed under the lock, so that stopping never shuts down a
+        // descriptor that has been reused
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->served.erase(fd);
+        close(fd);
+      }
+  }
+
+//! hang up on the clients of @a queue and let its workers return
+static void
+stop_clients(ClientQueue& queue)
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.stopping = true;
+    for (int fd : queue.clients)
+      {
+        close(fd);
+      }
+    queue.clients.clear();
+    for (int fd : queue.served)
+      {
+        shutdown(fd, SHUT_RDWR);
+      }
+    queue.waiting.notify_all();
+  }
+
+//! reload @a spellers each time SIGHUP in @a hangup is waiting, until it
+//! comes with @a stopping set
+static void
+reload_on_hangup(ZHfstOspellerHandle* spellers, sigset_t hangup,
+                 const std::atomic<bool>* stopping)
+  {
+    while (true)
+      {
+        int signal_number = 0;
+        if (sigwait(&hangup, &signal_number) != 0)
+          {
+            continue;
+          }
+        if (*stopping)
+          {
+            return;
+          }
+        try
+          {
+            spellers->reload();
+            fprintf(stderr, "speller reloaded\n");
+          }
+        catch (std::exception& e)
+          {
+            fprintf(stderr, "cannot reload speller:\n%s.\n", e.what());
+          }
+      }
+  }
+
+//! remove @a path if it is a socket left by an earlier server, but
+//! nothing else
+static bool
+remove_socket(const std::string& path)
+  {
+    struct stat status;
+    if (lstat(path.c_str(), &status) < 0)
+      {
+        if (errno == ENOENT)
+          {
+            return true;
+          }
+        perror(path.c_str());
+        return false;
+      }
+    if (!S_ISSOCK(status.st_mode))
+      {
+        fprintf(stderr, "%s exists and is not a socket\n", path.c_str());
+        return false;
+      }
+    if (unlink(path.c_str()) < 0)
+      {
+        perror(path.c_str());
+        return false;
+      }
+    return true;
+  }
+
+int
+serve_socket(ZHfstOspellerHandle& spellers, const std::string& path,
+             unsigned int workers)
+  {
+    struct sockaddr_un address;
+    if (path.size() >= sizeof(address.sun_path))
+      {
+        fprintf(stderr, "socket path %s is too long\n", path.c_str());
+        return EXIT_FAILURE;
+      }
+    if (!remove_socket(path))
+      {
+        return EXIT_FAILURE;
+      }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+      {
+        perror("socket");
+        return EXIT_FAILURE;
+      }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if ((bind(listener, reinterpret_cast<struct sockaddr*>(&address),
+              sizeof(address)) < 0) ||
+        (listen(listener, SOMAXCONN) < 0))
+      {
+        perror(path.c_str());
+        close(listener);
+        return EXIT_FAILURE;
+      }
+    // SIGHUP is only taken by the reloading thread; the workers started
+    // after it inherit the mask
+    sigset_t hangup;
+    sigemptyset(&hangup);
+    sigaddset(&hangup, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hangup, 0);
+    std::atomic<bool> stopping(false);
+    std::thread reloader(reload_on_hangup, &spellers, hangup, &stopping);
+    ClientQueue queue;
+    std::vector<std::thread> pool;
+    for (unsigned int i = 0; i < std::max(1u, workers); ++i)
+      {
+        pool.emplace_back(serve_clients, &spellers, &queue);
+      }
+    while (true)
+      {
+        int client = accept(listener, 0, 0);
+        if (client < 0)
+          {
+            if (errno == EINTR || errno == ECONNABORTED)
+              {
+                continue;
+              }
+            perror("accept");
+            break;
+          }
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.clients.push_back(client);
+        queue.waiting.notify_one();
+      }
+    // the threads use spellers, which the caller may destroy on return
+    stop_clients(queue);
+    for (auto& worker : pool)
+      {
+        worker.join();
+      }
+    stopping = true;
+    pthread_kill(reloader.native_handle(), SIGHUP);
+    reloader.join();
+    close(listener);
+    unlink(path.c_str());
+    return EXIT_FAILURE;
+  }
+
+#else // WINDOWS
+
+int
+serve_socket(ZHfstOspellerHandle&, const std::string&, unsigned int)
+  {
+    fprintf(stderr, "serving on a socket is not supported here\n");
+    return EXIT_FAILURE;
+  }
+
+#endif // WINDOWS
+
+  } // namespace hfst_ospell
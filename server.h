@@ -0,0 +1,46 @@
+/* -*- Mode: C++ -*- */
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef HFST_OSPELL_SERVER_H_
+#define HFST_OSPELL_SERVER_H_ 1
+
+#include <string>
+
+#include "ZHfstOspeller.h"
+
+namespace hfst_ospell
+  {
+    //! @brief answer spell, suggest and analyse requests of many clients
+    //!        with the speller of @a spellers on the Unix domain socket
+    //!        @a path.
+    //!
+    //! Every message either way is a 4 byte big-endian length followed by
+    //! that many bytes. A request is "spell WORD", "suggest WORD" or
+    //! "analyse WORD". Spell is answered with "1" or "0", the others with
+    //! a line of "STRING<tab>WEIGHT" per result. The clients are served
+    //! by @a workers threads, each taking the next waiting client when it
+    //! is done with one, and as many of them may search at the same time
+    //! as the speller has been set_concurrency() for. SIGHUP reloads the
+    //! archive of @a spellers without stopping the server. An old socket
+    //! at @a path is replaced, but any other file is left alone.
+    //!
+    //! @return EXIT_FAILURE if the socket cannot be set up, otherwise only
+    //!         returns when accepting clients fails, after all the threads
+    //!         using @a spellers have finished.
+    int serve_socket(ZHfstOspellerHandle& spellers, const std::string& path,
+                     unsigned int workers);
+  } // namespace hfst_ospell
+
+#endif // HFST_OSPELL_SERVER_H_
@@ -0,0 +1,40 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell ; then
+    rm -f cache-file.bin
+    if ! cat $srcdir/tests/test.strings | ./hfst-ospell -S --cache-file=cache-file.bin $srcdir/tests/speller_edit1.zhfst > cache-file.built ; then
+        exit 1
+    fi
+    if ! test -s cache-file.bin ; then
+        exit 1
+    fi
+    if ! cat $srcdir/tests/test.strings | ./hfst-ospell -S --cache-file=cache-file.bin $srcdir/tests/speller_edit1.zhfst > cache-file.read ; then
+        exit 1
+    fi
+    if ! cmp cache-file.built cache-file.read ; then
+        exit 1
+    fi
+    # the second run reads the cache instead of building it
+    if ! printf 'xolut\nolux\n' | ./hfst-ospell -v -S --cache-file=cache-file.bin $srcdir/tests/speller_edit1.zhfst > cache-file.verbose ; then
+        exit 1
+    fi
+    if grep -q '^Cache entries loaded: 0$' cache-file.verbose ||
+        ! grep -q '^Cache entries loaded: [0-9]' cache-file.verbose ||
+        ! grep -q '^Cache entries warmed: 0$' cache-file.verbose ||
+        ! grep -q '^Cache entries built while correcting: 0$' cache-file.verbose ; then
+        exit 1
+    fi
+    # a cache budget applies to the cache written, too
+    rm -f cache-file.small
+    if ! cat $srcdir/tests/test.strings | ./hfst-ospell -S --cache-budget=1 --cache-file=cache-file.small $srcdir/tests/speller_edit1.zhfst > cache-file.read ; then
+        exit 1
+    fi
+    if ! cmp cache-file.built cache-file.read ||
+        test $(wc -c < cache-file.small) -ge $(wc -c < cache-file.bin) ; then
+        exit 1
+    fi
+    rm -f cache-file.bin cache-file.small cache-file.built cache-file.read cache-file.verbose
+else
+    echo ./hfst-ospell not built
+    exit 77
+fi
@@ -0,0 +1,65 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell-predict ; then
+    trap "rm -f complete.out complete.index complete.indexed complete.zhfst complete.verbose" EXIT
+    if ! printf 'o\nolu\nx\n' |
+        ./hfst-ospell-predict --complete $srcdir/tests/speller_basic.zhfst > complete.out ; then
+        exit 1
+    fi
+    if ! printf 'Completions for "o":\nolut    0.000000\n\nCompletions for "olu":\nolut    0.000000\n\nUnable to complete "x"!\n\n' |
+        diff - complete.out ; then
+        exit 1
+    fi
+    # the index is written on the first run and read back on the second
+    for run in write read ; do
+        if ! printf 'o\nolu\nx\n' |
+            ./hfst-ospell-predict --complete --completion-file=complete.index \
+            $srcdir/tests/speller_basic.zhfst > complete.indexed ; then
+            exit 1
+        fi
+        if ! test -s complete.index || ! cmp complete.out complete.indexed ; then
+            exit 1
+        fi
+    done
+    # the prefixes are answered from the index read, even when more
+    # completions are asked for than it keeps per state
+    if ! printf 'o\nolu\nx\n' |
+        ./hfst-ospell-predict -v -n 20 --complete --completion-file=complete.index \
+        $srcdir/tests/speller_basic.zhfst > complete.verbose ; then
+        exit 1
+    fi
+    if grep -q 'entries loaded: 0$' complete.verbose ||
+        ! grep -q 'searched for completions: 0$' complete.verbose ; then
+        exit 1
+    fi
+    if command -v python3 > /dev/null ; then
+        # and from the archive
+        python3 - $srcdir/tests/speller_basic.zhfst complete.index complete.zhfst <<'PYTHON'
+import sys, zipfile
+source = zipfile.ZipFile(sys.argv[1])
+target = zipfile.ZipFile(sys.argv[3], 'w', zipfile.ZIP_DEFLATED)
+for entry in source.infolist():
+    target.writestr(entry, source.read(entry.filename))
+target.write(sys.argv[2], 'completions.default.bin')
+target.close()
+PYTHON
+        if ! printf 'o\nolu\nx\n' |
+            ./hfst-ospell-predict --complete complete.zhfst > complete.indexed ; then
+            exit 1
+        fi
+        if ! cmp complete.out complete.indexed ; then
+            exit 1
+        fi
+        if ! printf 'o\nolu\nx\n' |
+            ./hfst-ospell-predict -v -n 20 --complete complete.zhfst > complete.verbose ; then
+            exit 1
+        fi
+        if grep -q 'entries loaded: 0$' complete.verbose ||
+            ! grep -q 'searched for completions: 0$' complete.verbose ; then
+            exit 1
+        fi
+    fi
+else
+    echo ./hfst-ospell-predict not built
+    exit 77
+fi
@@ -0,0 +1,22 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell ; then
+    printf 'olut, olu\n«vesi» 3olu olu-olut olut\xe2\x80\x99 olu.\n' > document.text
+    if ! ./hfst-ospell --document $srcdir/tests/speller_edit1.zhfst < document.text > document.out ; then
+        exit 1
+    fi
+    printf '6\tolu\n12\tvesi\n24\tolu-olut\n41\tolu\n' > document.expected
+    if ! cmp document.out document.expected ; then
+        exit 1
+    fi
+    if ! ./hfst-ospell --document -S -j 2 $srcdir/tests/speller_edit1.zhfst < document.text > document.out ; then
+        exit 1
+    fi
+    if ! grep -q "^6	olu	olut" document.out ; then
+        exit 1
+    fi
+    rm -f document.text document.out document.expected
+else
+    echo ./hfst-ospell not built
+    exit 77
+fi
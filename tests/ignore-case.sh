@@ -0,0 +1,33 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell ; then
+    # the other cases of the letters are accepted and corrections keep the
+    # capitalization of the misspelling
+    if ! printf 'OLUT\nOlut\nXOLUT\nXolut\n' |
+        ./hfst-ospell -S --ignore-case $srcdir/tests/speller_edit1.zhfst > ignore-case.out ; then
+        exit 1
+    fi
+    for line in '"OLUT" is in the lexicon' '"Olut" is in the lexicon' \
+        '^OLUT  *1' '^Olut  *1' ; do
+        if ! grep -q "$line" ignore-case.out ; then
+            rm -f ignore-case.out
+            exit 1
+        fi
+    done
+    # so do capitals beyond Latin-1, here Sámi Ǧ and Kildin Sámi Ӄ
+    if test "$(printf '\xc7\xa6olut\n\xd3\x83olut\n' |
+        ./hfst-ospell -S --ignore-case $srcdir/tests/speller_edit1.zhfst |
+        grep -c '^Olut  *1')" != 2 ; then
+        rm -f ignore-case.out
+        exit 1
+    fi
+    if ! echo OLUT | ./hfst-ospell $srcdir/tests/speller_edit1.zhfst |
+        grep -q "NOT in the lexicon" ; then
+        rm -f ignore-case.out
+        exit 1
+    fi
+    rm -f ignore-case.out
+else
+    echo ./hfst-ospell not built
+    exit 77
+fi
@@ -0,0 +1,51 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell-predict ; then
+    trap "rm -f incremental.out incremental.expected incremental.verbose incremental.warning" EXIT
+    # typing words, deleting letters and typing again must give the same
+    # corrections as searching each line from scratch, whether the session
+    # is used under a weight limit or dropped without one
+    typed='x\nxo\nxol\nxolu\nxolut\nxolutx\nxolut\nxolu\nxol\nxola\nx\nv\nve\nves\nvesi\nvesix\nolut\nolu\nol\no\nsivolutesi\n\n'
+    for speller in speller_basic speller_edit1 speller_analyser ; do
+        for limit in "" "--max-weight=0.5" "--max-weight=2" ; do
+            if ! printf "$typed" |
+                ./hfst-ospell-predict $limit $srcdir/tests/$speller.zhfst > incremental.expected ; then
+                exit 1
+            fi
+            if ! printf "$typed" |
+                ./hfst-ospell-predict --incremental $limit \
+                $srcdir/tests/$speller.zhfst > incremental.out ; then
+                exit 1
+            fi
+            if ! cmp incremental.expected incremental.out ; then
+                exit 1
+            fi
+        done
+    done
+    if ! grep -q '^olut  *1' incremental.out ; then
+        exit 1
+    fi
+    # the session goes on from the line before only under a weight limit
+    if ! printf "$typed" | ./hfst-ospell-predict -v --incremental --max-weight=2 \
+        $srcdir/tests/speller_edit1.zhfst > incremental.verbose ; then
+        exit 1
+    fi
+    if grep -q 'line before: 0$' incremental.verbose ||
+        ! grep -q 'from scratch: 0$' incremental.verbose ; then
+        exit 1
+    fi
+    # without one it says that each line is searched from scratch
+    if ! printf "$typed" | ./hfst-ospell-predict -v --incremental \
+        $srcdir/tests/speller_edit1.zhfst > incremental.verbose \
+        2> incremental.warning ; then
+        exit 1
+    fi
+    if ! grep -q 'without --max-weight' incremental.warning ||
+        ! grep -q 'line before: 0$' incremental.verbose ||
+        grep -q 'from scratch: 0$' incremental.verbose ; then
+        exit 1
+    fi
+else
+    echo ./hfst-ospell-predict not built
+    exit 77
+fi
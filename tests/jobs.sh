@@ -0,0 +1,30 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell ; then
+    for i in 1 2 3 4 5 6 7 8 9 10 ; do
+        cat $srcdir/tests/test.strings
+        printf 'xolut\nolutx\nolux\n'
+    done > jobs.strings
+    if ! ./hfst-ospell -S $srcdir/tests/speller_edit1.zhfst < jobs.strings > jobs.plain ; then
+        exit 1
+    fi
+    if ! ./hfst-ospell -S -j 4 $srcdir/tests/speller_edit1.zhfst < jobs.strings > jobs.parallel ; then
+        exit 1
+    fi
+    if ! cmp jobs.plain jobs.parallel ; then
+        exit 1
+    fi
+    # the lines went through the pipeline and every copy of the speller
+    # is counted
+    if ! ./hfst-ospell -v -S -j 4 $srcdir/tests/speller_edit1.zhfst < jobs.strings > jobs.verbose ; then
+        exit 1
+    fi
+    if ! grep -q '^Checking 4 lines at a time$' jobs.verbose ||
+        ! grep -q '^Corrections searched: 70$' jobs.verbose ; then
+        exit 1
+    fi
+    rm -f jobs.strings jobs.plain jobs.parallel jobs.verbose
+else
+    echo ./hfst-ospell not built
+    exit 77
+fi
@@ -0,0 +1,42 @@
+#!/bin/bash
+
+if ! command -v python3 > /dev/null ; then
+    echo python3 not found
+    exit 77
+fi
+if test -x ./hfst-ospell-office ; then
+    trap "rm -f languages.zhfst" EXIT
+    # the edit distance 1 speller under another locale
+    python3 - $srcdir/tests/speller_edit1.zhfst languages.zhfst <<'PYTHON'
+import sys, zipfile
+source = zipfile.ZipFile(sys.argv[1])
+target = zipfile.ZipFile(sys.argv[2], 'w', zipfile.ZIP_DEFLATED)
+for entry in source.infolist():
+    data = source.read(entry.filename)
+    if entry.filename == 'index.xml':
+        data = data.replace(b'<locale>qtz</locale>', b'<locale>qtx</locale>')
+    target.writestr(entry, data)
+target.close()
+PYTHON
+    for limit in 0 1 ; do
+        if ! printf '5 xolut\n$$l qtx\n5 xolut\n$$l und\n$$l qtz\n5 xolut\n' |
+            ./hfst-ospell-office --memory-limit=$limit \
+            $srcdir/tests/speller_basic.zhfst languages.zhfst > languages.out ; then
+            exit 1
+        fi
+        if ! printf '@@ hfst-ospell-office is alive\n#\n@@ Option locale changed to qtx\n&\tolut\n@@ No speller for locale und\n@@ Option locale changed to qtz\n#\n' |
+            diff - languages.out ; then
+            rm -f languages.out
+            exit 1
+        fi
+    done
+    rm -f languages.out
+    # two archives of one locale
+    if ./hfst-ospell-office $srcdir/tests/speller_basic.zhfst \
+        $srcdir/tests/speller_edit1.zhfst < /dev/null ; then
+        exit 1
+    fi
+else
+    echo ./hfst-ospell-office not built
+    exit 77
+fi
@@ -0,0 +1,33 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell ; then
+    if ! cat $srcdir/tests/test.strings | ./hfst-ospell -S $srcdir/tests/speller_edit1.zhfst > node-budget.plain ; then
+        exit 1
+    fi
+    if ! cat $srcdir/tests/test.strings | ./hfst-ospell -S --node-budget=1000000 $srcdir/tests/speller_edit1.zhfst > node-budget.large ; then
+        exit 1
+    fi
+    if ! cmp node-budget.plain node-budget.large ; then
+        exit 1
+    fi
+    if ! cat $srcdir/tests/test.strings | ./hfst-ospell -v -S --node-budget=1000000 $srcdir/tests/speller_edit1.zhfst > node-budget.verbose ; then
+        exit 1
+    fi
+    if ! grep -q '^Searches stopped early: 0$' node-budget.verbose ; then
+        exit 1
+    fi
+    # a budget too small to reach any correction stops every search and
+    # leaves the misspelling uncorrected
+    if ! printf 'xolut\n' | ./hfst-ospell -v -S --node-budget=1 $srcdir/tests/speller_edit1.zhfst > node-budget.small ; then
+        exit 1
+    fi
+    if ! grep -q "stopped early" node-budget.small ||
+        ! grep -q '^Searches stopped early: 1$' node-budget.small ||
+        ! grep -q 'Unable to correct "xolut"' node-budget.small ; then
+        exit 1
+    fi
+    rm -f node-budget.plain node-budget.large node-budget.verbose node-budget.small
+else
+    echo ./hfst-ospell not built
+    exit 77
+fi
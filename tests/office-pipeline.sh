@@ -0,0 +1,23 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell-office ; then
+    # every request is answered once under its own ID, in whatever order
+    if ! printf 'a 5 xolut.\nb 5 olut\nc 5 zzz\nd oops\n$$w 5\ne 3 "oolut"\n' |
+        ./hfst-ospell-office --pipeline=3 $srcdir/tests/speller_edit1.zhfst > office-pipeline.out ; then
+        exit 1
+    fi
+    if ! printf '@@ Option max-weight changed to 5.00\n@@ hfst-ospell-office is alive\na\t&\tolut.\nb\t*\nc\t#\nd\t!\ne\t&\t"olut"\n' |
+        diff - <(LC_ALL=C sort office-pipeline.out) ; then
+        rm -f office-pipeline.out
+        exit 1
+    fi
+    # the option line comes after the answers to the requests before it
+    if ! sed -n 6p office-pipeline.out | grep -q '^@@ Option' ; then
+        rm -f office-pipeline.out
+        exit 1
+    fi
+    rm -f office-pipeline.out
+else
+    echo ./hfst-ospell-office not built
+    exit 77
+fi
@@ -0,0 +1,31 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell-office ; then
+    # the trimmed and lowercased variants are corrected in one search and
+    # put back together with what was trimmed
+    if ! printf '5 xolut.\n5 (xolut)\n5 Xolut\n5 olut.\n3 "oolut"\n5 zzz\n' |
+        ./hfst-ospell-office $srcdir/tests/speller_edit1.zhfst > office-variants.out ; then
+        exit 1
+    fi
+    if ! printf '@@ hfst-ospell-office is alive\n&\tolut.\n&\t(olut)\n&\tOlut\n*\n&\t"olut"\n#\n' |
+        diff - office-variants.out ; then
+        rm -f office-variants.out
+        exit 1
+    fi
+    # the maximum weight is for the corrections before the offsets of the
+    # variants
+    if ! printf '5 xolut.\n5 (xolut)\n' |
+        ./hfst-ospell-office -w 1 $srcdir/tests/speller_edit1.zhfst > office-variants.out ; then
+        rm -f office-variants.out
+        exit 1
+    fi
+    if ! printf '@@ hfst-ospell-office is alive\n&\tolut.\n&\t(olut)\n' |
+        diff - office-variants.out ; then
+        rm -f office-variants.out
+        exit 1
+    fi
+    rm -f office-variants.out
+else
+    echo ./hfst-ospell-office not built
+    exit 77
+fi
@@ -0,0 +1,57 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell-optimize ; then
+    if ! ./hfst-ospell-optimize $srcdir/tests/speller_edit1.zhfst optimize.zhfst ; then
+        exit 1
+    fi
+    if ! cat $srcdir/tests/test.strings | ./hfst-ospell -S $srcdir/tests/speller_edit1.zhfst > optimize.orig ; then
+        exit 1
+    fi
+    if ! cat $srcdir/tests/test.strings | ./hfst-ospell -S optimize.zhfst > optimize.opt ; then
+        exit 1
+    fi
+    if ! cmp optimize.orig optimize.opt ; then
+        exit 1
+    fi
+    if ! cat $srcdir/tests/test.strings | ./hfst-ospell -S --trace-states=optimize.trace $srcdir/tests/speller_edit1.zhfst > /dev/null ; then
+        exit 1
+    fi
+    if ! ./hfst-ospell-optimize --trace=optimize.trace $srcdir/tests/speller_edit1.zhfst optimize.zhfst ; then
+        exit 1
+    fi
+    if ! cat $srcdir/tests/test.strings | ./hfst-ospell -S optimize.zhfst > optimize.opt ; then
+        exit 1
+    fi
+    if ! cmp optimize.orig optimize.opt ; then
+        exit 1
+    fi
+    if command -v python3 > /dev/null ; then
+        # the cache and completion index of the old automata are left out
+        python3 - $srcdir/tests/speller_edit1.zhfst optimize-stale.zhfst <<'PYTHON'
+import sys, zipfile
+source = zipfile.ZipFile(sys.argv[1])
+target = zipfile.ZipFile(sys.argv[2], 'w', zipfile.ZIP_DEFLATED)
+for name in source.namelist():
+    target.writestr(name, source.read(name))
+target.writestr('cache.default.bin', 'stale')
+target.writestr('completions.default.bin', 'stale')
+target.close()
+PYTHON
+        if ! ./hfst-ospell-optimize optimize-stale.zhfst optimize.zhfst ; then
+            exit 1
+        fi
+        if ! python3 -c 'import sys, zipfile; sys.exit(any(n.startswith(("cache.", "completions.")) for n in zipfile.ZipFile(sys.argv[1]).namelist()))' optimize.zhfst ; then
+            exit 1
+        fi
+        if ! cat $srcdir/tests/test.strings | ./hfst-ospell -S optimize.zhfst > optimize.opt ; then
+            exit 1
+        fi
+        if ! cmp optimize.orig optimize.opt ; then
+            exit 1
+        fi
+    fi
+    rm -f optimize.zhfst optimize.orig optimize.opt optimize.trace optimize-stale.zhfst
+else
+    echo ./hfst-ospell-optimize not built
+    exit 77
+fi
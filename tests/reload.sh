@@ -0,0 +1,59 @@
+#!/bin/bash
+
+if ! command -v python3 > /dev/null ; then
+    echo python3 not found
+    exit 77
+fi
+if test -x ./hfst-ospell ; then
+    rm -f reload.socket reload.log
+    cp $srcdir/tests/speller_basic.zhfst reload.zhfst
+    ./hfst-ospell --server=reload.socket reload.zhfst 2> reload.log &
+    server=$!
+    trap "kill $server 2> /dev/null; rm -f reload.socket reload.zhfst reload.log" EXIT
+    for i in 1 2 3 4 5 6 7 8 9 10 ; do
+        test -S reload.socket && break
+        sleep 1
+    done
+    if ! python3 - $server <<'PYTHON'
+import os, shutil, signal, socket, struct, sys, time
+
+def ask(sock, request):
+    data = request.encode('utf-8')
+    sock.sendall(struct.pack('>I', len(data)) + data)
+    header = b''
+    while len(header) < 4:
+        header += sock.recv(4 - len(header))
+    length = struct.unpack('>I', header)[0]
+    reply = b''
+    while len(reply) < length:
+        reply += sock.recv(length - len(reply))
+    return reply.decode('utf-8')
+
+sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+sock.connect('reload.socket')
+# the basic error model cannot correct this
+if ask(sock, 'suggest xolut') != '':
+    raise SystemExit(1)
+shutil.copy(os.path.join(os.environ.get('srcdir', '.'),
+                         'tests/speller_edit1.zhfst'), 'reload.zhfst')
+os.kill(int(sys.argv[1]), signal.SIGHUP)
+for _ in range(100):
+    if 'speller reloaded' in open('reload.log').read():
+        break
+    time.sleep(0.1)
+else:
+    raise SystemExit(1)
+# the same client now gets the edit distance 1 model
+if not ask(sock, 'suggest xolut').startswith('olut\t'):
+    raise SystemExit(1)
+if ask(sock, 'spell olut') != '1':
+    raise SystemExit(1)
+sock.close()
+PYTHON
+    then
+        exit 1
+    fi
+else
+    echo ./hfst-ospell not built
+    exit 77
+fi
@@ -0,0 +1,63 @@
+#!/bin/bash
+
+if ! command -v python3 > /dev/null ; then
+    echo python3 not found
+    exit 77
+fi
+if test -x ./hfst-ospell ; then
+    # a file that is not a socket is not replaced
+    echo keep > server.socket
+    if ./hfst-ospell --server=server.socket $srcdir/tests/speller_edit1.zhfst 2> /dev/null ||
+        test "$(cat server.socket)" != keep ; then
+        rm -f server.socket
+        exit 1
+    fi
+    rm -f server.socket
+    ./hfst-ospell --server=server.socket $srcdir/tests/speller_edit1.zhfst &
+    server=$!
+    trap "kill $server 2> /dev/null; rm -f server.socket" EXIT
+    for i in 1 2 3 4 5 6 7 8 9 10 ; do
+        test -S server.socket && break
+        sleep 1
+    done
+    if ! python3 - <<'PYTHON'
+import socket, struct, threading
+
+def ask(sock, request):
+    data = request.encode('utf-8')
+    sock.sendall(struct.pack('>I', len(data)) + data)
+    header = b''
+    while len(header) < 4:
+        header += sock.recv(4 - len(header))
+    length = struct.unpack('>I', header)[0]
+    reply = b''
+    while len(reply) < length:
+        reply += sock.recv(length - len(reply))
+    return reply.decode('utf-8')
+
+failures = []
+
+def client():
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect('server.socket')
+    for _ in range(20):
+        if ask(sock, 'spell olut') != '1' or ask(sock, 'spell xolut') != '0':
+            failures.append('spell')
+        if not ask(sock, 'suggest xolut').startswith('olut\t'):
+            failures.append('suggest')
+    sock.close()
+
+threads = [threading.Thread(target=client) for _ in range(4)]
+for t in threads:
+    t.start()
+for t in threads:
+    t.join()
+raise SystemExit(1 if failures else 0)
+PYTHON
+    then
+        exit 1
+    fi
+else
+    echo ./hfst-ospell not built
+    exit 77
+fi
@@ -0,0 +1,34 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell ; then
+    # misspellings that end the same way, so that the memo gets used
+    printf 'xolut\nvolut\nsolut\nolutx\nolutv\nolux\nolut\n' > suffix-memo.strings
+    if ! ./hfst-ospell -S -w 2 $srcdir/tests/speller_edit1.zhfst < suffix-memo.strings > suffix-memo.plain ; then
+        exit 1
+    fi
+    if ! ./hfst-ospell -S -w 2 --suffix-memo=100000 $srcdir/tests/speller_edit1.zhfst < suffix-memo.strings > suffix-memo.memo ; then
+        exit 1
+    fi
+    if ! cmp suffix-memo.plain suffix-memo.memo ; then
+        exit 1
+    fi
+    if ! ./hfst-ospell -v -S -w 2 --suffix-memo=100000 $srcdir/tests/speller_edit1.zhfst < suffix-memo.strings > suffix-memo.verbose ; then
+        exit 1
+    fi
+    if grep -q '^Suffix memo hits: 0$' suffix-memo.verbose ||
+        ! grep -q '^Suffix memo hits: [0-9]' suffix-memo.verbose ; then
+        exit 1
+    fi
+    # without a weight limit an entry would hold every completion, so the
+    # memo is left alone
+    if ! ./hfst-ospell -v -S --suffix-memo=100000 $srcdir/tests/speller_edit1.zhfst < suffix-memo.strings > suffix-memo.verbose ; then
+        exit 1
+    fi
+    if ! grep -q '^Suffix memo misses: 0$' suffix-memo.verbose ; then
+        exit 1
+    fi
+    rm -f suffix-memo.strings suffix-memo.plain suffix-memo.memo suffix-memo.verbose
+else
+    echo ./hfst-ospell not built
+    exit 77
+fi
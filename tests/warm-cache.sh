@@ -0,0 +1,27 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell ; then
+    # only letters of the error model, whose entries are all warmed
+    printf 'xolut\nvolut\nolutx\nolux\nolut\n' > warm-cache.strings
+    if ! ./hfst-ospell -S $srcdir/tests/speller_edit1.zhfst < warm-cache.strings > warm-cache.cold ; then
+        exit 1
+    fi
+    if ! ./hfst-ospell -S --warm-cache=2 $srcdir/tests/speller_edit1.zhfst < warm-cache.strings > warm-cache.warm ; then
+        exit 1
+    fi
+    if ! cmp warm-cache.cold warm-cache.warm ; then
+        exit 1
+    fi
+    if ! ./hfst-ospell -v -S --warm-cache=2 $srcdir/tests/speller_edit1.zhfst < warm-cache.strings > warm-cache.verbose ; then
+        exit 1
+    fi
+    if grep -q '^Cache entries warmed: 0$' warm-cache.verbose ||
+        ! grep -q '^Cache entries warmed: [0-9]' warm-cache.verbose ||
+        ! grep -q '^Cache entries built while correcting: 0$' warm-cache.verbose ; then
+        exit 1
+    fi
+    rm -f warm-cache.strings warm-cache.cold warm-cache.warm warm-cache.verbose
+else
+    echo ./hfst-ospell not built
+    exit 77
+fi